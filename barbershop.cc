@@ -5,10 +5,191 @@
 #include "simulm.h"
 #include "barbershopem.h"
 
-int main() {
+/////////////////////////////////////////////////////////////////////
+// Parameter grid (sweep mode)
+/////////////////////////////////////////////////////////////////////
+// Grid file: one line per swept parameter, its name then its values,
+// e.g. "chairs 4 5 6", "arrival 8 10 12" or "service 8 9 10".
+// Parameters without a line keep their default value. Points are
+// numbered chairs first, then arrival, then service.
+/////////////////////////////////////////////////////////////////////
+
+#define MAX_VALUES 32         // Values per swept parameter
+
+struct Grid {
+  int nchairs, narrival, nservice;      // Number of values
+  int chairs[MAX_VALUES];               // Chairs values
+  float arrival[MAX_VALUES];            // Maximum inter-arrival times
+  float service[MAX_VALUES];            // Mean service times
+};
+
+// Reads a grid file (returns the number of points, 0 if error)
+
+int ReadGrid(const char *filename, Grid *g) {
+
+  FILE *f;
+  char line[256], *tok;
+  int *n;
+
+  g->nchairs=1;
+  g->chairs[0]=model.chairs;
+  g->narrival=1;
+  g->arrival[0]=model.arrival;
+  g->nservice=1;
+  g->service[0]=model.service;
+
+  f=fopen(filename,"r");
+  if (f==NULL) {
+    LogError("Error: cannot open grid file %s\n",filename);
+    return 0;
+  }
+  while (fgets(line,sizeof(line),f)!=NULL) {
+    tok=strtok(line," \t\r\n");
+    if (tok==NULL) continue;
+    if (strcmp(tok,"chairs")==0) n=&g->nchairs;
+    else if (strcmp(tok,"arrival")==0) n=&g->narrival;
+    else if (strcmp(tok,"service")==0) n=&g->nservice;
+    else {
+      LogError("Error: unknown parameter %s in grid file %s\n",tok,filename);
+      fclose(f);
+      return 0;
+    }
+    *n=0;
+    while (((tok=strtok(NULL," \t\r\n"))!=NULL) && (*n<MAX_VALUES)) {
+      if (n==&g->nchairs) g->chairs[*n]=atoi(tok);
+      else if (n==&g->narrival) g->arrival[*n]=atof(tok);
+      else g->service[*n]=atof(tok);
+      (*n)++;
+    }
+    if (*n==0) {
+      LogError("Error: no value for %s in grid file %s\n",line,filename);
+      fclose(f);
+      return 0;
+    }
+  }
+  fclose(f);
+  return g->nchairs*g->narrival*g->nservice;
+}
+
+// Model parameters of point #point
+
+void GridPoint(Grid *g, int point, ModelParams *p) {
+
+  *p=model;
+  p->chairs=g->chairs[point%g->nchairs];
+  point/=g->nchairs;
+  p->arrival=g->arrival[point%g->narrival];
+  point/=g->narrival;
+  p->service=g->service[point];
+}
+
+// Sweep set-up of a point (see Sweep)
+
+void SetupPoint(Simulation *sim, int point, void *data) {
+
+  ModelParams p;
+
+  GridPoint((Grid *)data,point,&p);
+  sim->Manager()->Configure(&p);
+}
+
+// Parameter columns of a point (see Sweep::Write)
+
+void LabelPoint(FILE *f, int point, void *data) {
+
+  ModelParams p;
+
+  GridPoint((Grid *)data,point,&p);
+  fprintf(f,"%d,%d,%g,%g",point,p.chairs,p.arrival,p.service);
+}
+
+int main(int argc, char *argv[]) {
 
   Simulation *sim;
-  int nreplic, tsim;
+  TraceWriter *trace;
+  Sweep *sweep;
+  Grid grid;
+  int nreplic, tsim, nthreads, gen, fel, npoints, anti, ref, batchmeans, batchclients, i;
+  double target;
+  float period, warmup, warmstart;
+  const char *ckpt, *resume, *gridfile;
+
+  // Options: -t <n> runs replications in parallel on n threads
+  //          -g <n> selects the random generator (RNG_* in simrng.h)
+  //          -e <n> selects the future event list (FEL_* in simulc.h,
+  //                 default: 4-ary heap)
+  //          -b <file> writes a binary event trace (see tracedump)
+  //          -l <n> sets the log level (LOG_* in simlog.h)
+  //          -s <n> -n <n> -c <n> simulate a chain of n shops, with n
+  //                 barbers and n chairs each (default: 1 1 5)
+  //          -w <h> runs replications until the mean and p99 waiting
+  //                 times are known within +/- h (relative), the
+  //                 number of replications being then a maximum
+  //          -k <file> checkpoints the run to file every minute (or
+  //                 every -p <t> units of simulated time)
+  //          -r <file> resumes the run saved in file (same options)
+  //          -u <t> deletes the statistics of the first t units of
+  //                 simulated time of each replication (warm-up)
+  //          -f <t> simulates a warm-up of t units once, then starts
+  //                 each replication from its final state
+  //          -S <file> runs the replications at each point of the
+  //                 parameter grid in file (on -t <n> threads) and
+  //                 writes one CSV row per point
+  //          -C 1   draws arrivals and services from their own streams
+  //                 (common random numbers across sweep points)
+  //          -a 1   runs sweep replications in antithetic pairs
+  //          -x <p> also writes the paired differences of each sweep
+  //                 point with point p
+  //          -v 1   uses the inter-arrival and service times as control
+  //                 variates (adjusted means and intervals)
+  //          -m <n> runs one long replication and computes batch means
+  //                 (1: non-overlapping, 2: overlapping), the number of
+  //                 replications being ignored
+  //          -q <n> closes a base batch every n clients (default: by
+  //                 simulated time, see Simulation::RunBatchMeans)
+
+  nthreads=0;
+  gen=RNG_LEWIS;
+  fel=FEL_HEAP4;
+  trace=NULL;
+  target=0;
+  period=0;
+  warmup=0;
+  warmstart=0;
+  ckpt=NULL;
+  resume=NULL;
+  gridfile=NULL;
+  anti=0;
+  ref=-1;
+  batchmeans=0;
+  batchclients=0;
+  for (i=1; i<argc-1; i++)
+    if (strcmp(argv[i],"-t")==0) nthreads=atoi(argv[++i]);
+    else if (strcmp(argv[i],"-g")==0) gen=atoi(argv[++i]);
+    else if (strcmp(argv[i],"-e")==0) fel=atoi(argv[++i]);
+    else if (strcmp(argv[i],"-b")==0) trace=new TraceWriter(argv[++i]);
+    else if (strcmp(argv[i],"-l")==0) SetLogLevel(atoi(argv[++i]));
+    else if (strcmp(argv[i],"-w")==0) target=atof(argv[++i]);
+    else if (strcmp(argv[i],"-s")==0) model.shops=atoi(argv[++i]);
+    else if (strcmp(argv[i],"-n")==0) model.barbers=atoi(argv[++i]);
+    else if (strcmp(argv[i],"-c")==0) model.chairs=atoi(argv[++i]);
+    else if (strcmp(argv[i],"-k")==0) ckpt=argv[++i];
+    else if (strcmp(argv[i],"-p")==0) period=atof(argv[++i]);
+    else if (strcmp(argv[i],"-r")==0) resume=argv[++i];
+    else if (strcmp(argv[i],"-u")==0) warmup=atof(argv[++i]);
+    else if (strcmp(argv[i],"-f")==0) warmstart=atof(argv[++i]);
+    else if (strcmp(argv[i],"-S")==0) gridfile=argv[++i];
+    else if (strcmp(argv[i],"-C")==0) model.crn=atoi(argv[++i]);
+    else if (strcmp(argv[i],"-a")==0) anti=atoi(argv[++i]);
+    else if (strcmp(argv[i],"-x")==0) ref=atoi(argv[++i]);
+    else if (strcmp(argv[i],"-v")==0) model.cv=atoi(argv[++i]);
+    else if (strcmp(argv[i],"-m")==0) batchmeans=atoi(argv[++i]);
+    else if (strcmp(argv[i],"-q")==0) batchclients=atoi(argv[++i]);
+
+  if (model.shops>MAX_RESOURCES) {     // One resource per shop
+    LogError("Error: at most %d shops\n",MAX_RESOURCES);
+    return 1;
+  }
 
   printf("\nNumber of replications: ");
   scanf("%d",&nreplic);
@@ -16,9 +197,41 @@ int main() {
   printf("\nSimulation time:        ");
   scanf("%d",&tsim);
   
-  sim=new Simulation(0,tsim,-1);
+  sim=new Simulation(0,Ticks(tsim),-1,fel,gen);
+  sim->SetTrace(trace);
+  if (ckpt!=NULL) sim->SetCheckpoint(ckpt,(period>0) ? 0 : 60,Ticks(period));
+  if (warmstart>0) sim->SetWarmup(Ticks(warmstart));
+  else sim->SetWarmup(Ticks(warmup));
 
   printf("\nBEGIN Barbershop Simulation\n\n");
-  sim->Run(nreplic);
+  if (gridfile!=NULL) {
+    npoints=ReadGrid(gridfile,&grid);
+    if (npoints==0) return 1;
+    sweep=new Sweep(sim,npoints,SetupPoint,&grid);
+    sweep->AddOutput(0,1,"wait");       // Mean waiting time (1st shop)
+    sweep->AddOutput(0,11,"wait_p99");  // Waiting time p99
+    sweep->AddOutput(0,2,"served");     // Clients served
+    sweep->AddOutput(0,13,"util");      // Utilization
+    sweep->AddOutput(0,14,"L");         // Mean number of clients
+    sweep->Run(nreplic,nthreads,anti);
+    printf("\n");
+    sweep->Write(stdout,"point,chairs,arrival,service",LabelPoint);
+    if ((ref>=0) && (ref<npoints)) {
+      printf("\n");
+      sweep->WriteDifferences(stdout,ref,"point,chairs,arrival,service",LabelPoint);
+    }
+    delete sweep;
+  } else if (target>0) {
+    sim->AddTarget(0,1,target,1);       // Mean waiting time
+    sim->AddTarget(0,11,target,1);      // Waiting time p99
+    sim->RunSequential(nreplic,nthreads);
+  } else if (batchmeans>0) sim->RunBatchMeans(batchclients,batchmeans==2);
+  else if (warmstart>0) sim->RunWarmStart(nreplic);
+  else if (resume!=NULL) {
+    if (!sim->Resume(resume,nreplic)) return 1;
+  } else if (nthreads>0) sim->RunParallel(nreplic,nthreads);
+  else sim->Run(nreplic);
   printf("\nEND Barbershop Simulation\n\n");
+
+  delete trace;
 }
@@ -7,13 +7,51 @@
 
 class Barber;
 
+// Event codes
+
+enum BarbershopEvent {
+  EV_INIT=0,                            // Initial event - MANDATORY!!
+  EV_ARRIVE=1,                          // Client arrives to barbershop
+  EV_SERVE=2,                           // Client being served
+  EV_LEAVE=3,                           // Finish serving
+  EV_ENTER=4,                           // Client enters the next shop
+  NEVENTS=5                             // Number of events
+};
+
+// Random streams (see Simulation::Rng(k))
+
+enum BarbershopStream {
+  STREAM_MAIN=0,                        // All draws (default)
+  STREAM_ARRIVAL=1,                     // Inter-arrival times (model.crn)
+  STREAM_SERVICE=2                      // Service times (model.crn)
+};
+
+// Model parameters (set before creating the Simulation, e.g. by main;
+// chairs, arrival, service and crn can be changed afterwards with
+// EventManager::Configure)
+
+struct ModelParams {
+  int shops;                            // Shops in the chain
+  int barbers;                          // Barbers per shop
+  int chairs;                           // Clients admitted per shop
+  float arrival;                        // Maximum inter-arrival time (uniform from 1)
+  float service;                        // Mean service time (exponential)
+  int crn;                              // 1: arrivals and services drawn from
+                                        // their own streams (common random numbers)
+  int cv;                               // 1: inter-arrival and service times used
+                                        // as control variates
+};
+
+ModelParams model={1,1,5,10,10,0,0};
+
 /////////////////////////////////////////////////////////////////////
 // CLASS EventManager
 /////////////////////////////////////////////////////////////////////
 // Simulation events management
 /////////////////////////////////////////////////////////////////////
 
-// The Event Manager must "know" all resources.
+// The Event Manager must "know" all resources. Events are executed
+// on the resource they were scheduled on (see Simulation::GetResource).
 
 class EventManager {
 
@@ -23,22 +61,25 @@ class EventManager {
 
     EventManager(Simulation *sim);      // Constructor
     ~EventManager();                    // Destructor
-    void ExecuteEvent(int code, Client *client); // Event execution
+    void ExecuteEvent(int code, Client *client, Resource *res); // Event execution (table)
+    void SwitchEvent(int code, Client *client, Resource *res); // Event execution (switch)
     void Init();                        // Initialization
     void InitRep();                     // Replication initialization 
     void Stats();                       // Stats computation (end of replication)
     void DisplayStats();                // Statistics display
+    void Configure(ModelParams *p);     // New chairs, arrival and service
 
   private:
 
     // Attributes
 
     Simulation *simul;                  // Pointer toward simulation object
+    EventFunction handlers[NEVENTS];    // Dispatch table
 
     // Resources
-	
-	Barber *barber;
 
+	Barber **shops;		//Shops of the chain
+	int nshops;			//Nr of shops
 
 };
 
@@ -55,6 +96,9 @@ class Client {
 		   Client();
 		   void setName(char n[STRS]);
 		   char* getName();
+           int id;                        // Client number (set by Simulation)
+           int handle;                    // Event handle (set by Simulation)
+           SimTime pdate;                 // Date of last P (set by Resource)
            Client *next;
            Client *previous;
 		   char name[STRS];
@@ -72,16 +116,66 @@ class Barber: public Resource {
    // Constructor
 
     Barber(char n[STRS], int cap, Simulation *sim);
+	void Configure(ModelParams *p);	//Chairs, arrival and service
+	void SetNext(Barber *shop);	//Next shop of the chain
 
    // Events
 	void Event0(Client *client); //The initial event
     void Event1(Client *client); //Client arrives
     void Event2(Client *client); //Client being served
 	void Event3(Client *client); //Finish serving/leave shop
+	void Event4(Client *client); //Client enters from previous shop
+
+   // Checkpoint
+	void Write(FILE *f);	//Writes the shop state
+	int Read(FILE *f, Client **byid, int n);	//Reads the shop state (1: ok)
   private:
+	void Enter(Client *client);	//Takes a chair, or leaves
 	int stack_size;		//Nr of chairs
 	int c_stack_size;	//Nr of free chairs
 	int arrived;		//Nr of arrived clients
 	int production;		//counter
+	float arrival;		//Maximum inter-arrival time
+	float service;		//Mean service time
+	int astream;		//Stream of inter-arrival times
+	int sstream;		//Stream of service times
+	int actrl;		//Inter-arrival times control variate (-1: none)
+	int sctrl;		//Service times control variate (-1: none)
+	Barber *next;		//Next shop (NULL: clients leave)
+};
+
+/////////////////////////////////////////////////////////////////////
+// Event handlers
+/////////////////////////////////////////////////////////////////////
+// One specialization per event code (see EventHandler in simulc.h)
+/////////////////////////////////////////////////////////////////////
+
+template <> struct EventHandler<EV_INIT> {
+  static void Execute(Client *client, Resource *res) {
+    static_cast<Barber *>(res)->Event0(client);
+  }
+};
+
+template <> struct EventHandler<EV_ARRIVE> {
+  static void Execute(Client *client, Resource *res) {
+    static_cast<Barber *>(res)->Event1(client);
+  }
 };
 
+template <> struct EventHandler<EV_SERVE> {
+  static void Execute(Client *client, Resource *res) {
+    static_cast<Barber *>(res)->Event2(client);
+  }
+};
+
+template <> struct EventHandler<EV_LEAVE> {
+  static void Execute(Client *client, Resource *res) {
+    static_cast<Barber *>(res)->Event3(client);
+  }
+};
+
+template <> struct EventHandler<EV_ENTER> {
+  static void Execute(Client *client, Resource *res) {
+    static_cast<Barber *>(res)->Event4(client);
+  }
+};
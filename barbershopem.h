@@ -14,10 +14,27 @@
 
 EventManager::EventManager(Simulation *sim) {
 
-  simul=sim;
+  char name[STRS];
+  int i;
 
-  // Resources instantiation
-	barber= new Barber("John the barber",1,simul);
+  simul=sim;
+  EventTable<NEVENTS>::Fill(handlers);
+
+  // Resources instantiation (shop #0 is resource #0: it gets EV_INIT)
+	nshops=(model.shops>0) ? model.shops : 1;
+	i=MAX_RESOURCES-simul->NbResources();	// Ids left (never -1)
+	if (nshops>i) {
+		LogError("Error: at most %d shops, using %d\n",i,i);
+		nshops=i;
+	}
+	shops=new Barber*[nshops];
+	for (i=0; i<nshops; i++) {
+		if (nshops==1) strcpy(name,"John the barber");
+		else sprintf(name,"Shop %d",i+1);
+		shops[i]=new Barber(name,model.barbers,simul);
+		shops[i]->Configure(&model);
+	}
+	for (i=0; i<nshops-1; i++) shops[i]->SetNext(shops[i+1]);
 
 }
 
@@ -25,25 +42,36 @@ EventManager::EventManager(Simulation *sim) {
 
 EventManager::~EventManager() {
 
+  int i;
+
   // Resources destruction
- 	delete barber;
+	for (i=0; i<nshops; i++) delete shops[i];
+	delete[] shops;
 
 }
 
 // CLASS EventManager: Events execution
+// Direct call through the dispatch table. Codes need no check: events
+// are scheduled by Schedule<code>() and P<code>() only, and checkpoint
+// reading rejects codes >= NEVENTS.
 
-void EventManager::ExecuteEvent(int code, Client *client) {
+void EventManager::ExecuteEvent(int code, Client *client, Resource *res) {
 
-  switch(code) {
+  handlers[code](client,res);
+}
 
- 
-  case 0:  barber->Event0(client);break;// Initial event - MANDATORY!!
+// CLASS EventManager: Events execution through a switch (see
+// Simulation::SetDispatch)
 
-  case 1:  barber->Event1(client);break;//Client arrives to barbershop
-  case 2:  barber->Event2(client);break;//Client being served
-  case 3:  barber->Event3(client);break;//Finish serving
-  
-  default: printf("Error: unknown event #%d at time %f\n",code,simul->Tnow());
+void EventManager::SwitchEvent(int code, Client *client, Resource *res) {
+
+  switch(code) {
+
+  case EV_INIT:   EventHandler<EV_INIT>::Execute(client,res);break;
+  case EV_ARRIVE: EventHandler<EV_ARRIVE>::Execute(client,res);break;
+  case EV_SERVE:  EventHandler<EV_SERVE>::Execute(client,res);break;
+  case EV_LEAVE:  EventHandler<EV_LEAVE>::Execute(client,res);break;
+  case EV_ENTER:  EventHandler<EV_ENTER>::Execute(client,res);break;
   }
 }
 
@@ -51,21 +79,27 @@ void EventManager::ExecuteEvent(int code, Client *client) {
 
 void EventManager::Init() {
 
+  int i;
+
   // Resources
 
-  barber->ResetStats();
+  for (i=0; i<nshops; i++) shops[i]->ResetStats();
 }
 
 // CLASS EventManager: Replications initialization
 
 void EventManager::InitRep() {
 
+  int i;
+
   // Scheduler
   simul->Sched()->Purge();
   
   // Resources
-  barber->ResetCounters();
-  barber->PurgeQueue();
+  for (i=0; i<nshops; i++) {
+    shops[i]->ResetCounters();
+    shops[i]->PurgeQueue();
+  }
   
 }
 
@@ -73,18 +107,32 @@ void EventManager::InitRep() {
 
 void EventManager::Stats() {
 
+  int i;
+
   // Resources
 
-  barber->Stats();
+  for (i=0; i<nshops; i++) shops[i]->Stats();
 }
 
 // CLASS EventManager: Stats display for each resource
 
 void EventManager::DisplayStats() {
 
+  int i;
+
   printf("\n*** SIMULATION STATISTICS ***\n\n");
   printf("\n*** RESOURCES\n");
-	barber->DisplayStats();
+  for (i=0; i<nshops; i++) shops[i]->DisplayStats();
+}
+
+// CLASS EventManager: New chairs, arrival, service and crn parameters for
+// each shop (between two replications; shops and barbers are fixed)
+
+void EventManager::Configure(ModelParams *p) {
+
+  int i;
+
+  for (i=0; i<nshops; i++) shops[i]->Configure(p);
 }
 
 /////////////////////////////////////////////////////////////////////
@@ -121,32 +169,98 @@ char* Client::getName(){
 	production=0;
 	arrived=0;
 	c_stack_size=0;
-	stack_size=5;
+	stack_size=0;
+	next=NULL;
+	actrl=-1;
+	sctrl=-1;
    }
 
+// CLASS Barber: Chairs, arrival, service, random streams and control
+// variates (inter-arrival times on the shop that generates arrivals,
+// service times on all)
+
+void Barber::Configure(ModelParams *p) {
+
+	if (p->chairs!=stack_size) {
+		stack_size=p->chairs;
+		TrackState(stack_size+1);	//Chairs occupancy (0..stack_size)
+	}
+	arrival=p->arrival;
+	service=p->service;
+	astream=(p->crn) ? STREAM_ARRIVAL : STREAM_MAIN;
+	sstream=(p->crn) ? STREAM_SERVICE : STREAM_MAIN;
+	if (p->cv && (sctrl<0)) {
+		if (Id()==0) actrl=AddControl("Inter-arrival time",0);
+		sctrl=AddControl("Service time",0);
+	}
+	SetControl(actrl,(1+arrival)/2);	//Known means
+	SetControl(sctrl,service);
+}
+
 
 //Class Barber : Event#0 The initial event
 
 void Barber::Event0(Client *client) {
 		c_stack_size=1;
+		SetState(c_stack_size);
 		arrived=1;
 
 		char cname[STRS];
 		sprintf(cname, "%d", arrived);
 		client->setName(cname);	
-		Sim()->Sched()->Schedule(1,Uni(0,10), client);
+		Sim()->Sched()->Schedule<EV_ARRIVE>(Ticks(Sim()->Variates(astream)->Uni(0,arrival)), client, Id());
 }
-// CLASS Barber : Event #1 Client Arrives
+// CLASS Barber: Next shop of the chain (clients leaving this shop
+// enter it)
 
-void Barber::Event1(Client *client) {
-		printf("Client %s arrived at time %f \n",client->getName(), Sim()->Tnow());
+void Barber::SetNext(Barber *shop) {
+
+	next=shop;
+}
+
+// CLASS Barber: Writes the shop state (checkpoint), after the
+// resource state
+
+void Barber::Write(FILE *f) {
+
+	Resource::Write(f);
+	fwrite(&c_stack_size,sizeof(c_stack_size),1,f);
+	fwrite(&arrived,sizeof(arrived),1,f);
+	fwrite(&production,sizeof(production),1,f);
+}
+
+// CLASS Barber: Reads the shop state written by Write() (1: ok)
+
+int Barber::Read(FILE *f, Client **byid, int n) {
+
+	int ok;
+
+	ok=Resource::Read(f,byid,n);
+	ok&=(fread(&c_stack_size,sizeof(c_stack_size),1,f)==1);
+	ok&=(fread(&arrived,sizeof(arrived),1,f)==1);
+	ok&=(fread(&production,sizeof(production),1,f)==1);
+	return ok;
+}
+
+// CLASS Barber: Client enters the shop: takes a chair, or leaves
+
+void Barber::Enter(Client *client) {
+		LogDebug("Client %s arrived at time %f \n",client->getName(), (double)Units(Sim()->Tnow()));
 		
 		if(c_stack_size<stack_size){	//Checks the number of free chairs
-		this->P(2,client,1);
+		this->P<EV_SERVE>(client,1);
 		  c_stack_size++;
+		  SetState(c_stack_size);
 		}else{
-		printf("Client %s left (No free chairs) %f \n",client->getName(), Sim()->Tnow());	
+		LogDebug("Client %s left (No free chairs) %f \n",client->getName(), (double)Units(Sim()->Tnow()));	
+		Sim()->KillClient(client);
 			}
+}
+
+// CLASS Barber : Event #1 Client Arrives
+
+void Barber::Event1(Client *client) {
+		Enter(client);
 		
 		Client *newclient; //Preparing the next client	recursively
 		char cname[STRS];
@@ -154,22 +268,34 @@ void Barber::Event1(Client *client) {
 		sprintf(cname, "%d", arrived);
 		newclient=Sim()->NewClient();
 		newclient->setName(cname);	
-		Sim()->Sched()->Schedule(1, Sim()->Tnow()+Uni(1,10), newclient);
+		SimReal delay=Sim()->Variates(astream)->Uni(1,arrival);
+		Observe(actrl,delay);
+		Sim()->Sched()->Schedule<EV_ARRIVE>(Sim()->Tnow()+Ticks(delay), newclient, Id());
 		
 }
 
 // CLASS Barber : Event #2 Client Being Served
 
 void Barber::Event2(Client *client){
-	printf("Begin serving client %s on Barber at time %f \n",client->getName(),Sim()->Tnow());
-	Sim()->Sched()->Schedule(3, Sim()->Tnow()+Exp(10), client);
+	LogDebug("Begin serving client %s on Barber at time %f \n",client->getName(),(double)Units(Sim()->Tnow()));
+	SimReal duration=Sim()->Variates(sstream)->Exp(service);
+	Observe(sctrl,duration);
+	Sim()->Sched()->Schedule<EV_LEAVE>(Sim()->Tnow()+Ticks(duration), client, Id());
 }
 
 // Class Barber : Event #3 Barber finishes serving, Client leaves the shop
 void Barber::Event3(Client *client){
-	printf("End serving client %s on Barber at time %f \n",client->getName(),Sim()->Tnow());
-	this->V();					//Releasing barber
+	LogDebug("End serving client %s on Barber at time %f \n",client->getName(),(double)Units(Sim()->Tnow()));
+	this->V(client);			//Releasing barber
 	production++;				//Another happy served client
-	Sim()->KillClient(client); 	//Client leaves the shop
+	if (next!=NULL)				//Client goes to the next shop
+		Sim()->Sched()->Schedule<EV_ENTER>(Sim()->Tnow(), client, next->Id());
+	else Sim()->KillClient(client); 	//Client leaves the chain
 	c_stack_size--;				//A slot in the queue is freed up
+	SetState(c_stack_size);
+}
+
+// Class Barber : Event #4 Client enters from the previous shop
+void Barber::Event4(Client *client){
+	Enter(client);
 }
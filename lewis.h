@@ -8,9 +8,17 @@
 // lewis.h: Lewis-Payne Random Generator
 // Invariable
 /////////////////////////////////////////////////////////////////////
-// Call: variable=randu(lp_tt). lp_tt is the random generator seed.
-// Its value must be initialized (e.g., to rand()) before first use
-// of function randu(). randu() returns a long double.
+// Call: variable=gen->Randu(), gen being a LewisPayne object. The
+// generator is seeded at construction or by Seed(); the seed must be
+// positive (e.g., rand()). Randu() returns a long double.
+// Each object holds its own state, so independent generators can be
+// used concurrently without locks.
+// LewisPayne is a RandomStream (simrng.h, which includes this file).
+// The shift register follows x^98+x^27+1 over GF(2) (period 2^98-1);
+// the seed only drives the shuffle. Substream(k) jumps the register
+// to k*2^64 steps past an offset drawn from the seed (Jump), so the
+// substreams of a seed are disjoint and those of different seeds
+// overlap with negligible probability.
 /////////////////////////////////////////////////////////////////////
 
 // Includes
@@ -21,7 +29,7 @@
 #include <math.h>
 #include <time.h>
 
-// Global variables used by the generator (prefixed by "lp_")
+// Generator constants (prefixed by "lp_")
 
 const long int lp_m[99]= {0,
                     692513452, 1183199546, -408704453,-1948498849,
@@ -51,58 +59,236 @@ const long int lp_m[99]= {0,
                    -885815584,-1787141026};
 
 const long int lp_im2p31=2147483647;
+const uint64_t lp_hi=(1ULL<<34)-1;      // Bits 64..97 of a polynomial
 
-long double lp_diviseur;
-long int lp_mm[99], lp_igerm, lp_ibat[129];
-int  lp_jrand, lp_krand;
-long int lp_tt;
+/////////////////////////////////////////////////////////////////////
+// CLASS LewisPayne
+/////////////////////////////////////////////////////////////////////
+// Lewis-Payne generator state and draws
+/////////////////////////////////////////////////////////////////////
 
-// randu() function
+class LewisPayne: public RandomStream {
 
-long double randu(long int& iu) {
+  public:
 
-  int  ii ;
-  long int indbat,u ;
-  long double temp  ;
+    // Methods
+
+    LewisPayne(long int seed);          // Constructor
+    void Seed(long int seed);           // Reinitialization
+    void Substream(long int k);         // Start of substream k (reseed)
+    long double Randu();                // Returns a draw in [0,1)
+    void Write(FILE *f);                // Writes state (checkpoint)
+    int Read(FILE *f);                  // Reads state (1: ok)
+
+  private:
+
+    // Internal methods
+
+    void Init(long int seed, long int k); // Register (substream k), then table
+    void Jump(long int k);              // Register to substream k
+    void Advance(uint64_t hi, uint64_t lo); // Register hi*2^64+lo steps ahead
+    void MulMod(uint64_t *a, uint64_t *b); // a=a*b mod x^98+x^27+1
+
+    // Private attributes
+
+    long int seed0;                     // Seed
+    long int tt;                        // Pending seed (<=0 once used)
+    long double diviseur;               // Scaling constant
+    long int mm[99];                    // Shift register
+    long int igerm;                     // Shuffle generator state
+    long int ibat[129];                 // Shuffle table
+    int jrand, krand;                   // Shift register indexes
+
+};
+
+// CLASS LewisPayne: Constructor
+
+LewisPayne::LewisPayne(long int seed) {
+
+  Seed(seed);
+}
+
+// CLASS LewisPayne: Reinitialization (effective on next draw)
+
+void LewisPayne::Seed(long int seed) {
+
+  seed0=seed;
+  tt=seed;
+}
+
+// CLASS LewisPayne: Start of substream k (k>=0): the register jumps
+// ahead, the shuffle is seeded with a hash of the seed and k
+
+void LewisPayne::Substream(long int k) {
+
+  Init(StreamSeed(seed0,k),k);
+}
+
+// CLASS LewisPayne: Initialization: register from lp_m (k<0) or
+// substream k, shuffle state from seed, then the shuffle table
+
+void LewisPayne::Init(long int seed, long int k) {
+
+  int ii;
+
+  diviseur=0.25/(1024.0*1024.0*1024.0);
+  for (ii=0; ii<=98; ii++) mm[ii]=lp_m[ii];
+  jrand=0;
+  if (k>=0) Jump(k);
+  igerm=seed;
+  tt=-1;
+  for (ii=1; ii<=128; ii++) {
+    // fill table ibat with 128 random values from shift register...
+    ++jrand;
+    if (jrand>98) jrand=1;
+    krand=jrand+27;
+    if (krand>98) krand=krand-98;
+    mm[jrand]^=mm[krand];
+    ibat[ii]=mm[jrand];
+  }
+}
+
+// CLASS LewisPayne: Register jump to substream k, R+k*2^64 steps
+// ahead (R<2^94: offset drawn from seed0)
+
+void LewisPayne::Jump(long int k) {
+
+  uint64_t r, lo;
 
-  if (iu>0) {
-    // init
-    lp_diviseur=0.25/(1024.0*1024.0*1024.0);
-    for (ii=0; ii<=98; ii++) lp_mm[ii]=lp_m[ii];
-    lp_jrand=0;
-    lp_igerm=iu;
-    iu=-1;
-    for (ii=1; ii<=128; ii++) {
-      // fill table ibat with 128 random values from shift register...
-      ++lp_jrand;
-      if (lp_jrand>98) lp_jrand=1;
-      lp_krand=lp_jrand+27;
-      if (lp_krand>98) lp_krand=lp_krand-98;
-      lp_mm[lp_jrand]^=lp_mm[lp_krand];
-      lp_ibat[ii]=lp_mm[lp_jrand];
+  r=(uint64_t)seed0;
+  lo=SplitMix64(r);
+  Advance((SplitMix64(r)&0x3FFFFFFFULL)+(uint64_t)k,lo);
+}
+
+// CLASS LewisPayne: Register J=hi*2^64+lo steps ahead. Each bit of
+// the register is a linear recurrence of polynomial P=x^98+x^27+1,
+// so with x^J mod P = sum c_i x^i, the word J+t steps ahead of the
+// oldest one, s[0], is the sum (xor) of the c_i s[i+t] (t=0..97).
+
+void LewisPayne::Advance(uint64_t hi, uint64_t lo) {
+
+  uint64_t c[2], x[2];
+  long int s[196];
+  int i, t, bit, j;
+
+  // c=x^J mod P (square and multiply, exponent hi:lo)
+  c[0]=1;
+  c[1]=0;
+  for (bit=127; bit>=0; bit--) {
+    x[0]=c[0];
+    x[1]=c[1];
+    MulMod(c,x);
+    if ((bit>=64) ? ((hi>>(bit-64))&1) : ((lo>>bit)&1)) {
+      c[1]=(c[1]<<1)|(c[0]>>63);        // c=c*x
+      c[0]<<=1;
+      if (c[1]>>34) {                   // x^98=x^27+1
+        c[1]&=lp_hi;
+        c[0]^=(1ULL<<27)|1;
+      }
+    }
+  }
+
+  // s: 98 register words, oldest first, then 98 more steps
+  j=jrand;
+  if (j==0) j=98;
+  for (t=0; t<98; t++) s[t]=mm[1+(j+t)%98];
+  for (t=98; t<196; t++) s[t]=s[t-98]^s[t-71];
+
+  for (t=0; t<98; t++) {
+    mm[1+(j+t)%98]=0;
+    for (i=0; i<98; i++)
+      if ((c[i>>6]>>(i&63))&1) mm[1+(j+t)%98]^=s[i+t];
+  }
+}
+
+// CLASS LewisPayne: a=a*b mod x^98+x^27+1 (polynomials over GF(2),
+// bits 0..97 of two words)
+
+void LewisPayne::MulMod(uint64_t *a, uint64_t *b) {
+
+  uint64_t r[2], t[2];
+  int i;
+
+  r[0]=0;
+  r[1]=0;
+  t[0]=b[0];
+  t[1]=b[1];
+  for (i=0; i<98; i++) {
+    if ((a[i>>6]>>(i&63))&1) {
+      r[0]^=t[0];
+      r[1]^=t[1];
+    }
+    t[1]=(t[1]<<1)|(t[0]>>63);          // t=t*x
+    t[0]<<=1;
+    if (t[1]>>34) {
+      t[1]&=lp_hi;
+      t[0]^=(1ULL<<27)|1;
     }
   }
+  a[0]=r[0];
+  a[1]=r[1];
+}
+
+// CLASS LewisPayne: Draw
+
+long double LewisPayne::Randu() {
+
+  long int indbat,u ;
+  long double temp  ;
+
+  if (tt>0) Init(tt,-1);                // init (DESP-C++ 1.1 register)
 
   // circulating (mod p) head of shift register
 
-  if (++lp_jrand>98) lp_jrand=1;
+  if (++jrand>98) jrand=1;
 
   // circulating (mod p) x**q
 
-  lp_krand=lp_jrand+27;
-  if (lp_krand>98) lp_krand-=98;
+  krand=jrand+27;
+  if (krand>98) krand-=98;
 
   // prepare x**(p-1) for next shift, result stored in x**0
 
-  lp_mm[lp_jrand]^=lp_mm[lp_krand];
-  lp_igerm*=65539;
-  lp_igerm&=lp_im2p31;
-  indbat=1+(lp_igerm/16777216);
-  u=lp_ibat[indbat];
-  lp_ibat[indbat]=lp_mm[lp_jrand];
-  temp=lp_diviseur*u;
+  mm[jrand]^=mm[krand];
+  igerm*=65539;
+  igerm&=lp_im2p31;
+  indbat=1+(igerm/16777216);
+  u=ibat[indbat];
+  ibat[indbat]=mm[jrand];
+  temp=diviseur*u;
   if (temp<=0) temp=temp+1.0 ;
   else if (temp>1) temp=1.0;
 
   return 1.0-temp; // 1 - randu
 }
+
+// CLASS LewisPayne: Writes the generator state (checkpoint)
+
+void LewisPayne::Write(FILE *f) {
+
+  fwrite(&seed0,sizeof(seed0),1,f);
+  fwrite(&tt,sizeof(tt),1,f);
+  fwrite(&diviseur,sizeof(diviseur),1,f);
+  fwrite(mm,sizeof(mm),1,f);
+  fwrite(&igerm,sizeof(igerm),1,f);
+  fwrite(ibat,sizeof(ibat),1,f);
+  fwrite(&jrand,sizeof(jrand),1,f);
+  fwrite(&krand,sizeof(krand),1,f);
+}
+
+// CLASS LewisPayne: Reads a state written by Write() (1 if successful)
+
+int LewisPayne::Read(FILE *f) {
+
+  int ok=1;
+
+  ok&=(fread(&seed0,sizeof(seed0),1,f)==1);
+  ok&=(fread(&tt,sizeof(tt),1,f)==1);
+  ok&=(fread(&diviseur,sizeof(diviseur),1,f)==1);
+  ok&=(fread(mm,sizeof(mm),1,f)==1);
+  ok&=(fread(&igerm,sizeof(igerm),1,f)==1);
+  ok&=(fread(ibat,sizeof(ibat),1,f)==1);
+  ok&=(fread(&jrand,sizeof(jrand),1,f)==1);
+  ok&=(fread(&krand,sizeof(krand),1,f)==1);
+  return ok;
+}
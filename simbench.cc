@@ -0,0 +1,371 @@
+/////////////////////////////////////////////////////////////////////
+// simbench.cc: DESP engine benchmarks
+/////////////////////////////////////////////////////////////////////
+// Usage: simbench [n]  (n: number of operations per measure)
+// Output: one CSV line per measure on standard output (the model's
+// own output is sent to /dev/null)
+//   benchmark,variant,parameter,operations,ns_per_op,ops_per_s,
+//   heap_allocs_per_op,arena_allocs_per_op,fast_path
+// heap_allocs counts operator new calls and arena chunks taken from
+// the heap; arena_allocs counts objects served by the arena (free
+// list or bump pointer). fast_path is the fraction of the events
+// scheduled that took the zero-delay ring (model runs only).
+// Compare runs with e.g. join or a spreadsheet.
+/////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <new>
+#include <chrono>
+#include "simutil.h"
+#include "simulc.h"
+#include "barbershopec.h"
+#include "simulm.h"
+#include "barbershopem.h"
+
+/////////////////////////////////////////////////////////////////////
+// Allocation counter (every operator new of the program)
+/////////////////////////////////////////////////////////////////////
+
+long nnew=0;                            // operator new calls
+
+void *operator new(size_t size) {
+
+  void *p;
+
+  nnew++;
+  p=malloc(size>0 ? size : 1);
+  if (p==NULL) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+
+  free(p);
+}
+
+/////////////////////////////////////////////////////////////////////
+// Timing and reporting
+/////////////////////////////////////////////////////////////////////
+
+FILE *out;                              // Results stream
+
+double Seconds() {
+
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Counters of a measure (taken before and after)
+
+struct Counters {
+  double secs;                          // Date
+  long heap;                            // Heap allocations
+  long arena;                           // Arena allocations
+};
+
+long ArenaAllocs(Arena *a) {
+
+  long sum=0;
+  int i;
+
+  if (a==NULL) return 0;
+  for (i=0; i<ARENA_TYPES; i++) sum+=a->Allocs(i);
+  return sum;
+}
+
+void Start(Counters *c, Arena *a) {
+
+  c->heap=nnew+(a!=NULL ? a->HeapAllocs() : 0);
+  c->arena=ArenaAllocs(a);
+  c->secs=Seconds();
+}
+
+void Report(const char *bench, const char *variant, long param, long nops,
+            Counters *c, Arena *a, double fast=-1) {
+
+  double secs;
+  long heap, arena;
+
+  secs=Seconds()-c->secs;
+  heap=nnew+(a!=NULL ? a->HeapAllocs() : 0)-c->heap;
+  arena=ArenaAllocs(a)-c->arena;
+  fprintf(out,"%s,%s,%ld,%ld,%.3f,%.0f,%.6f,%.6f,",bench,variant,param,nops,
+          1e9*secs/nops,nops/secs,(double)heap/nops,(double)arena/nops);
+  if (fast>=0) fprintf(out,"%.4f\n",fast);
+  else fprintf(out,"\n");
+  fflush(out);
+}
+
+/////////////////////////////////////////////////////////////////////
+// Future event lists: hold model (PopNext + Schedule) at a
+// constant number of pending events
+/////////////////////////////////////////////////////////////////////
+
+const char *FELNAMES[5]={"list","heap","heap4","calendar","ladder"};
+
+#define INCREMENTS 65536                // Pre-drawn date increments
+
+void BenchScheduler(long n) {
+
+  static const long DEPTHS[5]={10,100,1000,10000,100000};
+  RandomStream *rg;
+  Arena *arena;
+  Scheduler *sched;
+  Counters c;
+  EventRecord ev;
+  SimTime *inc;
+  long i, nops;
+  int f, d;
+
+  rg=NewRandomStream(RNG_LEWIS,DEFAULT_SEED);
+  inc=new SimTime[INCREMENTS];
+  for (i=0; i<INCREMENTS; i++) inc[i]=Ticks(Exp(rg,1));
+
+  for (f=FEL_LIST; f<=FEL_LADDER; f++)
+    for (d=0; d<5; d++) {
+      if ((f==FEL_LIST) && (DEPTHS[d]>1000)) continue; // O(n) insert
+      arena=new Arena;
+      sched=new Scheduler(arena,f);
+      for (i=0; i<DEPTHS[d]; i++) sched->Schedule<EV_ARRIVE>(DEPTHS[d]*inc[i%INCREMENTS],NULL);
+      nops=(f==FEL_LIST) ? n/10 : n;
+      if (nops<1) nops=1;
+      Start(&c,arena);
+      for (i=0; i<nops; i++) {
+        sched->PopNext(&ev);
+        sched->Schedule<EV_ARRIVE>(ev.date+DEPTHS[d]*inc[i&(INCREMENTS-1)],NULL);
+      }
+      Report("fel_hold",FELNAMES[f],DEPTHS[d],nops,&c,arena);
+      delete sched;
+      delete arena;
+    }
+
+  delete[] inc;
+  delete rg;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Resources: V + P with a deep queue (FIFO: equal priorities, and
+// priorities in 0..9)
+/////////////////////////////////////////////////////////////////////
+
+void BenchResource(long n) {
+
+  static const long DEPTHS[4]={1,100,1000,10000};
+  Simulation *sim;
+  Resource *res;
+  Scheduler *sched;
+  Client **clients, **byhandle;
+  Counters c;
+  EventRecord ev;
+  long i;
+  int d, prio, nclients, maxhandle;
+
+  for (prio=0; prio<2; prio++)
+    for (d=0; d<4; d++) {
+      sim=new Simulation(0,Ticks(1e9),-1);
+      sched=sim->Sched();
+      res=new Resource((char *)"bench",1,sim);
+      res->ResetCounters();
+      nclients=DEPTHS[d]+1;
+      clients=new Client*[nclients];
+      maxhandle=0;
+      for (i=0; i<nclients; i++) {
+        clients[i]=sim->NewClient();
+        if (clients[i]->handle>maxhandle) maxhandle=clients[i]->handle;
+        res->P<EV_SERVE>(clients[i],prio ? IUni(sim->Rng(),0,9) : 0);
+      }
+      byhandle=new Client*[maxhandle+1];
+      for (i=0; i<nclients; i++) byhandle[clients[i]->handle]=clients[i];
+      Start(&c,sim->Mem());
+      for (i=0; i<n; i++) {
+        res->V();                       // Next client scheduled
+        sched->PopNext(&ev);            // Served client queues again
+        res->P<EV_SERVE>(byhandle[ev.client],prio ? (i*7)%10 : 0);
+      }
+      Report(prio ? "resource_pv_prio" : "resource_pv_fifo","heap4",DEPTHS[d],n,
+             &c,sim->Mem());
+      delete[] byhandle;
+      delete[] clients;
+      delete res;
+      delete sim;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+// Random generators: draws per second
+/////////////////////////////////////////////////////////////////////
+
+const char *RNGNAMES[4]={"lewis","xoshiro","pcg","philox"};
+
+void BenchRandom(long n) {
+
+  RandomStream *rg;
+  Counters c;
+  long double sum;
+  long i;
+  int k;
+
+  for (k=RNG_LEWIS; k<=RNG_PHILOX; k++) {
+    rg=NewRandomStream(k,DEFAULT_SEED);
+    sum=0;
+    Start(&c,NULL);
+    for (i=0; i<n; i++) sum+=rg->Randu();
+    Report("randu",RNGNAMES[k],0,n,&c,NULL);
+    if (sum<0) printf("#\n");           // Keeps the loop alive
+    delete rg;
+  }
+}
+
+/////////////////////////////////////////////////////////////////////
+// Variates: each scalar function (default generator), then for each
+// generator the exponential and an alternation of uniform and
+// exponential draws (a barbershop stream) on the simutil.h functions,
+// then through a VariateStream with each transform kernel the
+// processor supports (buffered scalar calls and blocks)
+/////////////////////////////////////////////////////////////////////
+
+const char *KERNELNAMES[3]={"scalar","avx2","avx512"};
+
+void BenchVariates(long n) {
+
+  RandomStream *rg;
+  VariateStream *vs;
+  Counters c;
+  char variant[32];
+  double sum, blk[VARBUF];
+  long i, isum;
+  int k, j, m, best;
+
+  rg=NewRandomStream(RNG_LEWIS,DEFAULT_SEED);
+  sum=0;
+  isum=0;
+
+  Start(&c,NULL);
+  for (i=0; i<n; i++) sum+=Poisson(rg,10);
+  Report("poisson",RNGNAMES[RNG_LEWIS],0,n,&c,NULL);
+
+  Start(&c,NULL);
+  for (i=0; i<n; i++) isum+=IPoisson(rg,10);
+  Report("ipoisson",RNGNAMES[RNG_LEWIS],0,n,&c,NULL);
+
+  Start(&c,NULL);
+  for (i=0; i<n; i++) isum+=IExp(rg,10);
+  Report("iexp",RNGNAMES[RNG_LEWIS],0,n,&c,NULL);
+
+  Start(&c,NULL);
+  for (i=0; i<n; i++) sum+=Uni(rg,0,10);
+  Report("uni",RNGNAMES[RNG_LEWIS],0,n,&c,NULL);
+
+  Start(&c,NULL);
+  for (i=0; i<n; i++) isum+=IUni(rg,0,10);
+  Report("iuni",RNGNAMES[RNG_LEWIS],0,n,&c,NULL);
+
+  if ((sum<0) || (isum<0)) printf("#\n"); // Keeps the loops alive
+  delete rg;
+
+  best=VariateKernel();
+  for (k=RNG_LEWIS; k<=RNG_PHILOX; k++) {
+    rg=NewRandomStream(k,DEFAULT_SEED);
+    vs=new VariateStream(rg);
+    sum=0;
+
+    Start(&c,NULL);
+    for (i=0; i<n; i++) sum+=Exp(rg,10);
+    Report("exp_scalar",RNGNAMES[k],0,n,&c,NULL);
+
+    Start(&c,NULL);
+    for (i=0; i<n; i+=2) sum+=Uni(rg,1,10)+Exp(rg,10);
+    Report("mixed_scalar",RNGNAMES[k],0,n,&c,NULL);
+
+    for (m=VAR_SCALAR; m<=best; m++) {
+      SetVariateKernel(m);
+      sprintf(variant,"%s/%s",RNGNAMES[k],KERNELNAMES[m]);
+
+      Start(&c,NULL);
+      for (i=0; i<n; i++) sum+=vs->Exp(10);
+      Report("exp_buffered",variant,0,n,&c,NULL);
+
+      Start(&c,NULL);
+      for (i=0; i<n; i+=2) sum+=vs->Uni(1,10)+vs->Exp(10);
+      Report("mixed_buffered",variant,0,n,&c,NULL);
+
+      Start(&c,NULL);
+      for (i=0; i<n; i+=VARBUF) {
+        vs->ExpBlock(10,blk,VARBUF);
+        for (j=0; j<VARBUF; j++) sum+=blk[j];
+      }
+      Report("exp_block",variant,VARBUF,n,&c,NULL);
+    }
+    SetVariateKernel(best);
+
+    if (sum<0) printf("#\n");           // Keeps the loops alive
+    delete vs;
+    delete rg;
+  }
+}
+
+/////////////////////////////////////////////////////////////////////
+// Barbershop model: events per second (event dispatch included), for
+// each dispatch mode, each future event list and several simulation
+// lengths
+/////////////////////////////////////////////////////////////////////
+
+const char *DISPATCHNAMES[2]={"table","switch"};
+
+void BenchModel() {
+
+  static const long TSIM[3]={1000,10000,100000};
+  Simulation *sim;
+  Counters c;
+  char variant[32];
+  long events, scheduled, immediate;
+  int m, f, t;
+
+  SetLogLevel(LOG_ERROR);                // No narration in the measure
+  for (m=DISPATCH_TABLE; m<=DISPATCH_SWITCH; m++)
+    for (f=FEL_LIST; f<=FEL_LADDER; f++)
+      for (t=0; t<3; t++) {
+        sim=new Simulation(0,Ticks(TSIM[t]),-1,f);
+        sim->SetDispatch(m);
+        sprintf(variant,"%s/%s",DISPATCHNAMES[m],FELNAMES[f]);
+        events=sim->Events();
+        scheduled=sim->Sched()->Scheduled();
+        immediate=sim->Sched()->Immediate();
+        Start(&c,sim->Mem());
+        sim->Run(10);
+        scheduled=sim->Sched()->Scheduled()-scheduled;
+        immediate=sim->Sched()->Immediate()-immediate;
+        Report("run_events",variant,TSIM[t],sim->Events()-events,&c,sim->Mem(),
+               (scheduled>0) ? (double)immediate/scheduled : 0);
+        delete sim;
+      }
+}
+
+/////////////////////////////////////////////////////////////////////
+// Main
+/////////////////////////////////////////////////////////////////////
+
+int main(int argc, char *argv[]) {
+
+  long n=10000000;
+
+  if (argc>1) n=atol(argv[1]);
+
+  out=fdopen(dup(fileno(stdout)),"w");
+  if (freopen("/dev/null","w",stdout)==NULL) out=stderr;
+
+  fprintf(out,"benchmark,variant,parameter,operations,ns_per_op,ops_per_s,"
+          "heap_allocs_per_op,arena_allocs_per_op,fast_path\n");
+  BenchScheduler(n);
+  BenchResource(n);
+  BenchRandom(n);
+  BenchVariates(n);
+  BenchModel();
+}
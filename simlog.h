@@ -0,0 +1,77 @@
+/////////////////////////////////////////////////////////////////////
+// DESP-C++ (Discrete-Event Simulation Package)
+/////////////////////////////////////////////////////////////////////
+// simlog.h: Log messages
+// Invariable
+/////////////////////////////////////////////////////////////////////
+// Messages are printed through printf-like macros, by level:
+//
+// - LogError(...):  errors
+// - LogInfo(...):   simulation progress
+// - LogDebug(...):  event narration (one message per event)
+//
+// LOG_LEVEL (compile time, e.g. -DLOG_LEVEL=0) removes the macros
+// above it: at LOG_OFF, no message code is generated at all (the
+// arguments are still type-checked, behind an if (0)).
+// Default: LOG_DEBUG, or LOG_ERROR when NDEBUG is defined.
+// SetLogLevel() further filters messages at run time.
+/////////////////////////////////////////////////////////////////////
+
+#ifndef SIMLOG_H
+#define SIMLOG_H
+
+// Includes
+
+#include <stdio.h>
+
+/////////////////////////////////////////////////////////////////////
+// Constants
+/////////////////////////////////////////////////////////////////////
+
+#define LOG_OFF 0             // No message
+#define LOG_ERROR 1           // Errors only
+#define LOG_INFO 2            // Errors and progress
+#define LOG_DEBUG 3           // Everything
+
+#ifndef LOG_LEVEL
+#ifdef NDEBUG
+#define LOG_LEVEL LOG_ERROR
+#else
+#define LOG_LEVEL LOG_DEBUG
+#endif
+#endif
+
+/////////////////////////////////////////////////////////////////////
+// Run-time level
+/////////////////////////////////////////////////////////////////////
+
+int log_level=LOG_LEVEL;                // Set before running simulations
+
+void SetLogLevel(int level) {
+
+  log_level=level;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Macros
+/////////////////////////////////////////////////////////////////////
+
+#if LOG_LEVEL>=LOG_ERROR
+#define LogError(...) do { if (log_level>=LOG_ERROR) printf(__VA_ARGS__); } while (0)
+#else
+#define LogError(...) do { if (0) printf(__VA_ARGS__); } while (0)
+#endif
+
+#if LOG_LEVEL>=LOG_INFO
+#define LogInfo(...) do { if (log_level>=LOG_INFO) printf(__VA_ARGS__); } while (0)
+#else
+#define LogInfo(...) do { if (0) printf(__VA_ARGS__); } while (0)
+#endif
+
+#if LOG_LEVEL>=LOG_DEBUG
+#define LogDebug(...) do { if (log_level>=LOG_DEBUG) printf(__VA_ARGS__); } while (0)
+#else
+#define LogDebug(...) do { if (0) printf(__VA_ARGS__); } while (0)
+#endif
+
+#endif
@@ -0,0 +1,757 @@
+/////////////////////////////////////////////////////////////////////
+// DESP-C++ (Discrete-Event Simulation Package)
+/////////////////////////////////////////////////////////////////////
+// simrng.h: Random stream family
+// Invariable
+/////////////////////////////////////////////////////////////////////
+// All generators derive from RandomStream:
+//
+// - Seed(seed):    reinitialization (seed>0)
+// - Substream(k):  positions the generator at the start of substream k
+//                  of the current seed (k>=0)
+// - Randu():       returns a draw in [0,1)
+// - Fill(u,n):     n consecutive draws (same values as n Randu())
+// - Write(f):      writes the generator state (binary)
+// - Read(f):       restores a state written by Write() (1: ok); the
+//                  draws then continue bit-identically
+//
+// Available generators (see NewRandomStream()):
+//
+// - RNG_LEWIS:     Lewis-Payne (lewis.h). Substreams are 2^64 draws
+//                  apart in the shift register, after an offset drawn
+//                  from the seed (O(log k) jump polynomial). Seed()
+//                  alone keeps the DESP-C++ 1.1 sequence, whose register
+//                  does not depend on the seed.
+// - RNG_XOSHIRO:   xoshiro256++ (Blackman & Vigna). Substreams are
+//                  2^128 draws apart. Substream k is reached from the
+//                  current one (or from substream 0 if k is smaller)
+//                  by one jump polynomial per bit of the distance,
+//                  taken from a table of powers of two: O(log k) in
+//                  any visiting order, O(1) for the next substream.
+// - RNG_PCG:       PCG64, XSL-RR output on a 128-bit LCG (O'Neill).
+//                  Substreams are 2^64 draws apart (O(1) advance).
+// - RNG_PHILOX:    Philox4x32-10, counter-based (Salmon et al.).
+//                  Substream k is counter block k<<64 (O(1)).
+//
+// Antithetic(s) is a view of stream s that returns 1-u for each draw
+// u of s (antithetic replications).
+/////////////////////////////////////////////////////////////////////
+
+// Includes
+
+#include <stdio.h>
+#include <stdint.h>
+
+/////////////////////////////////////////////////////////////////////
+// Constants
+/////////////////////////////////////////////////////////////////////
+
+#define RNG_LEWIS 0           // Lewis-Payne
+#define RNG_XOSHIRO 1         // xoshiro256++
+#define RNG_PCG 2             // PCG64
+#define RNG_PHILOX 3          // Philox4x32-10
+
+#define RNG_2P53 (1.0/9007199254740992.0) // 2^-53
+#define XOSHIRO_JUMPS 63      // Jump polynomials (substream bits)
+
+/////////////////////////////////////////////////////////////////////
+// CLASS RandomStream
+/////////////////////////////////////////////////////////////////////
+// Random generator interface
+/////////////////////////////////////////////////////////////////////
+
+class RandomStream {
+
+  public:
+
+    // Methods
+
+    virtual ~RandomStream();            // Destructor
+    virtual void Seed(long int seed)=0; // Reinitialization
+    virtual void Substream(long int k)=0; // Start of substream k
+    virtual long double Randu()=0;      // Returns a draw in [0,1)
+    virtual void Fill(double *u, int n); // n consecutive draws
+    virtual void Write(FILE *f)=0;      // Writes state (checkpoint)
+    virtual int Read(FILE *f)=0;        // Reads state (1: ok)
+
+};
+
+// CLASS RandomStream: Destructor
+
+RandomStream::~RandomStream() {
+
+}
+
+// CLASS RandomStream: n consecutive draws
+
+void RandomStream::Fill(double *u, int n) {
+
+  int i;
+
+  for (i=0; i<n; i++) u[i]=(double)Randu();
+}
+
+/////////////////////////////////////////////////////////////////////
+// Seed mixing (SplitMix64)
+/////////////////////////////////////////////////////////////////////
+
+uint64_t SplitMix64(uint64_t& x) {
+
+  uint64_t z;
+
+  x+=0x9E3779B97F4A7C15ULL;
+  z=x;
+  z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+  z=(z^(z>>27))*0x94D049BB133111EBULL;
+  return z^(z>>31);
+}
+
+// Hash of a seed and a substream number, in 1..2^31-2 (seeds of
+// derived streams, and Lewis-Payne shuffle seeds)
+
+long int StreamSeed(long int seed, long int k) {
+
+  uint64_t x;
+
+  x=(uint64_t)seed*0x9E3779B97F4A7C15ULL+(uint64_t)k;
+  x^=x>>30;
+  x*=0xBF58476D1CE4E5B9ULL;
+  x^=x>>27;
+  x*=0x94D049BB133111EBULL;
+  x^=x>>31;
+
+  return (long int)(x%2147483646ULL)+1;
+}
+
+// Lewis-Payne generator
+
+#include "lewis.h"
+
+/////////////////////////////////////////////////////////////////////
+// CLASS XoshiroJumps
+/////////////////////////////////////////////////////////////////////
+// Jump polynomials of xoshiro256: poly b is x^(2^(128+b)) modulo the
+// characteristic polynomial of the generator, i.e. a jump of 2^b
+// substreams. Built once, before main() (read-only afterwards, so
+// threads share it).
+/////////////////////////////////////////////////////////////////////
+
+class XoshiroJumps {
+
+  public:
+
+    // Methods
+
+    XoshiroJumps();                     // Constructor (builds the table)
+    const uint64_t *Poly(int b);        // Jump of 2^b substreams
+
+  private:
+
+    // Internal methods
+
+    void Square(const uint64_t *a, uint64_t *res); // a^2 mod characteristic
+
+    // Private attributes
+
+    uint64_t poly[XOSHIRO_JUMPS][4];    // Jump polynomials (bit i: x^i)
+
+};
+
+// CLASS XoshiroJumps: Constructor
+// Poly 0 is the jump polynomial of the xoshiro authors; each next one
+// is the square of the previous one.
+
+XoshiroJumps::XoshiroJumps() {
+
+  static const uint64_t JUMP[4]={0x180ec6d33cfd0abaULL,0xd5a61266f0c9392cULL,
+                                 0xa9582618e03fc9aaULL,0x39abdc4529b1661cULL};
+  int b, i;
+
+  for (i=0; i<4; i++) poly[0][i]=JUMP[i];
+  for (b=1; b<XOSHIRO_JUMPS; b++) Square(poly[b-1],poly[b]);
+}
+
+// CLASS XoshiroJumps: Returns the jump polynomial of 2^b substreams
+
+const uint64_t *XoshiroJumps::Poly(int b) {
+
+  return poly[b];
+}
+
+// CLASS XoshiroJumps: Square modulo the characteristic polynomial
+// (Horner: res=res*x+a_i from the highest coefficient)
+
+void XoshiroJumps::Square(const uint64_t *a, uint64_t *res) {
+
+  // Characteristic polynomial of xoshiro256 (x^256 term implied)
+  static const uint64_t CHAR[4]={0x9d116f2bb0f0f001ULL,0x0280002bcefd1a5eULL,
+                                 0x04b4edcf26259f85ULL,0x0003c03c3f3ecb19ULL};
+  uint64_t r[4]={0,0,0,0}, carry;
+  int i, j;
+
+  for (i=255; i>=0; i--) {
+    carry=r[3]>>63;
+    for (j=3; j>0; j--) r[j]=(r[j]<<1)|(r[j-1]>>63);
+    r[0]<<=1;
+    if (carry) for (j=0; j<4; j++) r[j]^=CHAR[j];
+    if ((a[i>>6]>>(i&63))&1) for (j=0; j<4; j++) r[j]^=a[j];
+  }
+  for (j=0; j<4; j++) res[j]=r[j];
+}
+
+XoshiroJumps xoshirojumps;              // Shared table
+
+/////////////////////////////////////////////////////////////////////
+// CLASS Xoshiro256
+/////////////////////////////////////////////////////////////////////
+// xoshiro256++ generator
+/////////////////////////////////////////////////////////////////////
+
+class Xoshiro256: public RandomStream {
+
+  public:
+
+    // Methods
+
+    Xoshiro256(long int seed);          // Constructor
+    void Seed(long int seed);           // Reinitialization
+    void Substream(long int k);         // Start of substream k
+    long double Randu();                // Returns a draw in [0,1)
+    void Fill(double *u, int n);        // n consecutive draws
+    uint64_t Next();                    // Returns 64 random bits
+    void Jump();                        // Skips 2^128 draws
+    void Jump(const uint64_t *poly);    // Applies a jump polynomial
+    void Write(FILE *f);                // Writes state (checkpoint)
+    int Read(FILE *f);                  // Reads state (1: ok)
+
+  private:
+
+    // Private attributes
+
+    uint64_t s[4];                      // Current state
+    uint64_t base[4];                   // State at substream 0
+    uint64_t sub[4];                    // State at current substream
+    long int cursub;                    // Current substream
+
+};
+
+// CLASS Xoshiro256: Constructor
+
+Xoshiro256::Xoshiro256(long int seed) {
+
+  Seed(seed);
+}
+
+// CLASS Xoshiro256: Reinitialization
+
+void Xoshiro256::Seed(long int seed) {
+
+  uint64_t x=(uint64_t)seed;
+  int i;
+
+  for (i=0; i<4; i++) {
+    base[i]=SplitMix64(x);
+    sub[i]=base[i];
+    s[i]=base[i];
+  }
+  cursub=0;
+}
+
+// CLASS Xoshiro256: Start of substream k
+// The distance from the current substream is jumped one set bit at a
+// time (the jumps commute)
+
+void Xoshiro256::Substream(long int k) {
+
+  unsigned long d;
+  int i, b;
+
+  if (k<cursub) {                       // Restart from substream 0
+    for (i=0; i<4; i++) sub[i]=base[i];
+    cursub=0;
+  }
+  for (i=0; i<4; i++) s[i]=sub[i];
+  for (d=k-cursub, b=0; d!=0; d>>=1, b++)
+    if (d&1) Jump(xoshirojumps.Poly(b));
+  for (i=0; i<4; i++) sub[i]=s[i];
+  cursub=k;
+}
+
+// CLASS Xoshiro256: 64 random bits
+
+uint64_t Xoshiro256::Next() {
+
+  uint64_t res, t;
+
+  res=s[0]+s[3];
+  res=((res<<23)|(res>>41))+s[0];
+  t=s[1]<<17;
+  s[2]^=s[0];
+  s[3]^=s[1];
+  s[1]^=s[2];
+  s[0]^=s[3];
+  s[2]^=t;
+  s[3]=(s[3]<<45)|(s[3]>>19);
+
+  return res;
+}
+
+// CLASS Xoshiro256: Draw
+
+long double Xoshiro256::Randu() {
+
+  return (Next()>>11)*RNG_2P53;
+}
+
+// CLASS Xoshiro256: n consecutive draws
+
+void Xoshiro256::Fill(double *u, int n) {
+
+  int i;
+
+  for (i=0; i<n; i++) u[i]=(Next()>>11)*RNG_2P53;
+}
+
+// CLASS Xoshiro256: Jump (equivalent to 2^128 calls to Next())
+
+void Xoshiro256::Jump() {
+
+  Jump(xoshirojumps.Poly(0));
+}
+
+// CLASS Xoshiro256: Applies a jump polynomial (the state becomes
+// the sum of the states after i calls to Next() for each term x^i)
+
+void Xoshiro256::Jump(const uint64_t *poly) {
+
+  uint64_t t[4]={0,0,0,0};
+  int i, b, j;
+
+  for (i=0; i<4; i++)
+    for (b=0; b<64; b++) {
+      if (poly[i]&((uint64_t)1<<b))
+        for (j=0; j<4; j++) t[j]^=s[j];
+      Next();
+    }
+  for (j=0; j<4; j++) s[j]=t[j];
+}
+
+// CLASS Xoshiro256: Writes the generator state (checkpoint)
+
+void Xoshiro256::Write(FILE *f) {
+
+  fwrite(s,sizeof(s),1,f);
+  fwrite(base,sizeof(base),1,f);
+  fwrite(sub,sizeof(sub),1,f);
+  fwrite(&cursub,sizeof(cursub),1,f);
+}
+
+// CLASS Xoshiro256: Reads a state written by Write() (1 if successful)
+
+int Xoshiro256::Read(FILE *f) {
+
+  int ok=1;
+
+  ok&=(fread(s,sizeof(s),1,f)==1);
+  ok&=(fread(base,sizeof(base),1,f)==1);
+  ok&=(fread(sub,sizeof(sub),1,f)==1);
+  ok&=(fread(&cursub,sizeof(cursub),1,f)==1);
+  return ok;
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLASS Pcg64
+/////////////////////////////////////////////////////////////////////
+// PCG64 generator (pcg_setseq_128_xsl_rr_64)
+/////////////////////////////////////////////////////////////////////
+
+typedef unsigned __int128 uint128_t;
+
+#define PCG_MULT (((uint128_t)0x2360ED051FC65DA4ULL<<64)|0x4385DF649FCCF645ULL)
+#define PCG_INC (((uint128_t)0x5851F42D4C957F2DULL<<64)|0x14057B7EF767814FULL)
+
+class Pcg64: public RandomStream {
+
+  public:
+
+    // Methods
+
+    Pcg64(long int seed);               // Constructor
+    void Seed(long int seed);           // Reinitialization
+    void Substream(long int k);         // Start of substream k
+    long double Randu();                // Returns a draw in [0,1)
+    void Fill(double *u, int n);        // n consecutive draws
+    uint64_t Next();                    // Returns 64 random bits
+    void Advance(uint128_t delta);      // Skips delta draws
+    void Write(FILE *f);                // Writes state (checkpoint)
+    int Read(FILE *f);                  // Reads state (1: ok)
+
+  private:
+
+    // Private attributes
+
+    uint128_t state;                    // Current state
+    uint128_t base;                     // State at substream 0
+
+};
+
+// CLASS Pcg64: Constructor
+
+Pcg64::Pcg64(long int seed) {
+
+  Seed(seed);
+}
+
+// CLASS Pcg64: Reinitialization
+
+void Pcg64::Seed(long int seed) {
+
+  uint64_t x=(uint64_t)seed;
+  uint128_t init;
+
+  init=((uint128_t)SplitMix64(x)<<64)|SplitMix64(x);
+  state=0;
+  Next();
+  state+=init;
+  Next();
+  base=state;
+}
+
+// CLASS Pcg64: Start of substream k
+
+void Pcg64::Substream(long int k) {
+
+  state=base;
+  Advance((uint128_t)k<<64);
+}
+
+// CLASS Pcg64: 64 random bits
+
+uint64_t Pcg64::Next() {
+
+  uint64_t x;
+  unsigned rot;
+
+  state=state*PCG_MULT+PCG_INC;
+  x=(uint64_t)(state>>64)^(uint64_t)state;
+  rot=(unsigned)(state>>122);
+
+  return (x>>rot)|(x<<((-rot)&63));
+}
+
+// CLASS Pcg64: Draw
+
+long double Pcg64::Randu() {
+
+  return (Next()>>11)*RNG_2P53;
+}
+
+// CLASS Pcg64: n consecutive draws
+
+void Pcg64::Fill(double *u, int n) {
+
+  int i;
+
+  for (i=0; i<n; i++) u[i]=(Next()>>11)*RNG_2P53;
+}
+
+// CLASS Pcg64: Jump ahead (O(log delta) LCG composition)
+
+void Pcg64::Advance(uint128_t delta) {
+
+  uint128_t accmult=1, accplus=0, curmult=PCG_MULT, curplus=PCG_INC;
+
+  while (delta>0) {
+    if (delta&1) {
+      accmult*=curmult;
+      accplus=accplus*curmult+curplus;
+    }
+    curplus=(curmult+1)*curplus;
+    curmult*=curmult;
+    delta>>=1;
+  }
+  state=accmult*state+accplus;
+}
+
+// CLASS Pcg64: Writes the generator state (checkpoint)
+
+void Pcg64::Write(FILE *f) {
+
+  fwrite(&state,sizeof(state),1,f);
+  fwrite(&base,sizeof(base),1,f);
+}
+
+// CLASS Pcg64: Reads a state written by Write() (1 if successful)
+
+int Pcg64::Read(FILE *f) {
+
+  int ok=1;
+
+  ok&=(fread(&state,sizeof(state),1,f)==1);
+  ok&=(fread(&base,sizeof(base),1,f)==1);
+  return ok;
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLASS Philox
+/////////////////////////////////////////////////////////////////////
+// Philox4x32-10 counter-based generator. Each 128-bit counter value
+// gives 4 words (2 draws). Counter: block number (low 64 bits) and
+// substream number (high 64 bits).
+/////////////////////////////////////////////////////////////////////
+
+class Philox: public RandomStream {
+
+  public:
+
+    // Methods
+
+    Philox(long int seed);              // Constructor
+    void Seed(long int seed);           // Reinitialization
+    void Substream(long int k);         // Start of substream k
+    long double Randu();                // Returns a draw in [0,1)
+    void Fill(double *u, int n);        // n consecutive draws
+    void SetCounter(uint64_t block);    // Jumps to block in substream
+    void Write(FILE *f);                // Writes state (checkpoint)
+    int Read(FILE *f);                  // Reads state (1: ok)
+
+  private:
+
+    // Internal methods
+
+    void Generate();                    // Encrypts counter into out
+
+    // Private attributes
+
+    uint32_t key[2];                    // Key (from seed)
+    uint32_t ctr[4];                    // Counter
+    uint32_t out[4];                    // Current block
+    int used;                           // Words used in out
+
+};
+
+// CLASS Philox: Constructor
+
+Philox::Philox(long int seed) {
+
+  Seed(seed);
+}
+
+// CLASS Philox: Reinitialization
+
+void Philox::Seed(long int seed) {
+
+  uint64_t x=(uint64_t)seed, k;
+
+  k=SplitMix64(x);
+  key[0]=(uint32_t)k;
+  key[1]=(uint32_t)(k>>32);
+  Substream(0);
+}
+
+// CLASS Philox: Start of substream k
+
+void Philox::Substream(long int k) {
+
+  ctr[2]=(uint32_t)k;
+  ctr[3]=(uint32_t)((uint64_t)k>>32);
+  SetCounter(0);
+}
+
+// CLASS Philox: Jumps to a block of the current substream
+
+void Philox::SetCounter(uint64_t block) {
+
+  ctr[0]=(uint32_t)block;
+  ctr[1]=(uint32_t)(block>>32);
+  used=4;
+}
+
+// CLASS Philox: Encryption of the counter (10 rounds)
+
+void Philox::Generate() {
+
+  uint32_t c0=ctr[0], c1=ctr[1], c2=ctr[2], c3=ctr[3];
+  uint32_t k0=key[0], k1=key[1];
+  uint64_t p0, p1;
+  int r;
+
+  for (r=0; r<10; r++) {
+    p0=(uint64_t)0xD2511F53*c0;
+    p1=(uint64_t)0xCD9E8D57*c2;
+    c0=(uint32_t)(p1>>32)^c1^k0;
+    c1=(uint32_t)p1;
+    c2=(uint32_t)(p0>>32)^c3^k1;
+    c3=(uint32_t)p0;
+    k0+=0x9E3779B9;
+    k1+=0xBB67AE85;
+  }
+  out[0]=c0;
+  out[1]=c1;
+  out[2]=c2;
+  out[3]=c3;
+
+  // Counter increment (block number only)
+  if (++ctr[0]==0) ctr[1]++;
+}
+
+// CLASS Philox: Draw (53 bits from two words)
+
+long double Philox::Randu() {
+
+  uint64_t x;
+
+  if (used==4) {
+    Generate();
+    used=0;
+  }
+  x=((uint64_t)out[used]<<32)|out[used+1];
+  used+=2;
+
+  return (x>>11)*RNG_2P53;
+}
+
+// CLASS Philox: n consecutive draws
+
+void Philox::Fill(double *u, int n) {
+
+  uint64_t x;
+  int i;
+
+  for (i=0; i<n; i++) {
+    if (used==4) {
+      Generate();
+      used=0;
+    }
+    x=((uint64_t)out[used]<<32)|out[used+1];
+    used+=2;
+    u[i]=(x>>11)*RNG_2P53;
+  }
+}
+
+// CLASS Philox: Writes the generator state (checkpoint)
+
+void Philox::Write(FILE *f) {
+
+  fwrite(key,sizeof(key),1,f);
+  fwrite(ctr,sizeof(ctr),1,f);
+  fwrite(out,sizeof(out),1,f);
+  fwrite(&used,sizeof(used),1,f);
+}
+
+// CLASS Philox: Reads a state written by Write() (1 if successful)
+
+int Philox::Read(FILE *f) {
+
+  int ok=1;
+
+  ok&=(fread(key,sizeof(key),1,f)==1);
+  ok&=(fread(ctr,sizeof(ctr),1,f)==1);
+  ok&=(fread(out,sizeof(out),1,f)==1);
+  ok&=(fread(&used,sizeof(used),1,f)==1);
+  return ok;
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLASS Antithetic
+/////////////////////////////////////////////////////////////////////
+// Antithetic view of a stream: draws are 1-u (0 stays 0, so that
+// draws stay in [0,1)). Seeding, substreams and state are those of
+// the underlying stream, which the view does not own.
+/////////////////////////////////////////////////////////////////////
+
+class Antithetic: public RandomStream {
+
+  public:
+
+    // Methods
+
+    Antithetic(RandomStream *s);        // Constructor
+    void Seed(long int seed);           // Reinitialization
+    void Substream(long int k);         // Start of substream k
+    long double Randu();                // Returns a draw in [0,1)
+    void Fill(double *u, int n);        // n consecutive draws
+    void Write(FILE *f);                // Writes state (checkpoint)
+    int Read(FILE *f);                  // Reads state (1: ok)
+
+  private:
+
+    // Private attributes
+
+    RandomStream *stream;               // Underlying stream
+
+};
+
+// CLASS Antithetic: Constructor
+
+Antithetic::Antithetic(RandomStream *s) {
+
+  stream=s;
+}
+
+// CLASS Antithetic: Reinitialization (of the underlying stream)
+
+void Antithetic::Seed(long int seed) {
+
+  stream->Seed(seed);
+}
+
+// CLASS Antithetic: Start of substream k (of the underlying stream)
+
+void Antithetic::Substream(long int k) {
+
+  stream->Substream(k);
+}
+
+// CLASS Antithetic: Draw
+
+long double Antithetic::Randu() {
+
+  long double u=stream->Randu();
+
+  if (u>0) return 1-u;
+  else return 0;
+}
+
+// CLASS Antithetic: n consecutive draws
+
+void Antithetic::Fill(double *u, int n) {
+
+  int i;
+
+  stream->Fill(u,n);
+  for (i=0; i<n; i++)
+    if (u[i]>0) u[i]=1-u[i];
+}
+
+// CLASS Antithetic: Writes the state of the underlying stream
+
+void Antithetic::Write(FILE *f) {
+
+  stream->Write(f);
+}
+
+// CLASS Antithetic: Reads the state of the underlying stream
+
+int Antithetic::Read(FILE *f) {
+
+  return stream->Read(f);
+}
+
+/////////////////////////////////////////////////////////////////////
+// Generator factory
+/////////////////////////////////////////////////////////////////////
+
+RandomStream *NewRandomStream(int kind, long int seed) {
+
+  switch(kind) {
+
+  case RNG_LEWIS:   return new LewisPayne(seed);
+  case RNG_XOSHIRO: return new Xoshiro256(seed);
+  case RNG_PCG:     return new Pcg64(seed);
+  case RNG_PHILOX:  return new Philox(seed);
+
+  default: LogError("Error: unknown random generator #%d, using Lewis-Payne\n",kind);
+           return new LewisPayne(seed);
+  }
+}
@@ -0,0 +1,926 @@
+/////////////////////////////////////////////////////////////////////
+// DESP-C++ (Discrete-Event Simulation Package)
+/////////////////////////////////////////////////////////////////////
+// simstat.h: Statistics collectors
+// Invariable
+/////////////////////////////////////////////////////////////////////
+
+#ifndef SIMSTAT_H
+#define SIMSTAT_H
+
+// Includes
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+/////////////////////////////////////////////////////////////////////
+// Constants
+/////////////////////////////////////////////////////////////////////
+
+#define HIST_SUBBITS 7                  // log2(sub-buckets per octave)
+#define HIST_SUB (1<<HIST_SUBBITS)      // Sub-buckets per octave
+#define HIST_OCTAVES (65-HIST_SUBBITS)  // Octaves of 64-bit values
+#define HIST_UNIT 0.001                 // Default resolution
+#define ACC_TAG "ACC"                   // Accumulator serialized form tag
+#define COV_TAG "COV"                   // Covariance serialized form tag
+
+/////////////////////////////////////////////////////////////////////
+// CLASS Accumulator
+/////////////////////////////////////////////////////////////////////
+// Count, mean and sum of squared deviations of a series, updated in
+// double precision with Welford's recurrence (no cancellation, unlike
+// sums of squares). Two accumulators merge exactly with Chan et al.'s
+// formula, so series split over threads, processes or separate runs
+// can be combined. Save() writes one text line with hexadecimal
+// floats (exact round trip); Load() reads it back.
+/////////////////////////////////////////////////////////////////////
+
+class Accumulator {
+
+  public:
+
+    // Methods
+
+    Accumulator();                      // Constructor
+    void Reset();                       // Removes all values
+    void Add(double x);                 // New value
+    void Merge(Accumulator *a);         // Adds the values of a
+    long Count();                       // Returns # of values
+    double Mean();                      // Returns mean value
+    double Variance();                  // Returns variance (divided by n)
+    double SampleVariance();            // Returns variance (divided by n-1)
+    double Min();                       // Returns minimum value
+    double Max();                       // Returns maximum value
+    void Save(FILE *f);                 // Writes serialized form
+    int Load(FILE *f);                  // Reads serialized form (1: ok)
+    void Write(FILE *f);                // Writes binary state (checkpoint)
+    int Read(FILE *f);                  // Reads binary state (1: ok)
+
+  private:
+
+    // Private attributes
+
+    long n;                             // Number of values
+    double mean;                        // Mean value
+    double m2;                          // Sum of squared deviations
+    double min, max;                    // Extreme values
+
+};
+
+// CLASS Accumulator: Constructor
+
+Accumulator::Accumulator() {
+
+  Reset();
+}
+
+// CLASS Accumulator: Removes all values
+
+void Accumulator::Reset() {
+
+  n=0;
+  mean=0;
+  m2=0;
+  min=0;
+  max=0;
+}
+
+// CLASS Accumulator: New value (Welford)
+
+void Accumulator::Add(double x) {
+
+  double delta;
+
+  n++;
+  delta=x-mean;
+  mean+=delta/n;
+  m2+=delta*(x-mean);
+  if ((n==1) || (x<min)) min=x;
+  if ((n==1) || (x>max)) max=x;
+}
+
+// CLASS Accumulator: Adds the values of a (Chan et al.)
+
+void Accumulator::Merge(Accumulator *a) {
+
+  double delta;
+  long nt;
+
+  if (a->n==0) return;
+  if (n==0) {
+    *this=*a;
+    return;
+  }
+  nt=n+a->n;
+  delta=a->mean-mean;
+  mean+=delta*a->n/nt;
+  m2+=a->m2+delta*delta*((double)n*a->n/nt);
+  if (a->min<min) min=a->min;
+  if (a->max>max) max=a->max;
+  n=nt;
+}
+
+// CLASS Accumulator: Returns the number of values
+
+long Accumulator::Count() {
+
+  return n;
+}
+
+// CLASS Accumulator: Returns the mean value
+
+double Accumulator::Mean() {
+
+  return mean;
+}
+
+// CLASS Accumulator: Returns the variance (population: divided by n)
+
+double Accumulator::Variance() {
+
+  if (n>0) return m2/n;
+  else return 0;
+}
+
+// CLASS Accumulator: Returns the variance (sample: divided by n-1)
+
+double Accumulator::SampleVariance() {
+
+  if (n>1) return m2/(n-1);
+  else return 0;
+}
+
+// CLASS Accumulator: Returns the minimum value
+
+double Accumulator::Min() {
+
+  return min;
+}
+
+// CLASS Accumulator: Returns the maximum value
+
+double Accumulator::Max() {
+
+  return max;
+}
+
+// CLASS Accumulator: Writes the serialized form
+// ("ACC n mean m2 min max", floats in hexadecimal)
+
+void Accumulator::Save(FILE *f) {
+
+  fprintf(f,"%s %ld %a %a %a %a\n",ACC_TAG,n,mean,m2,min,max);
+}
+
+// CLASS Accumulator: Reads the serialized form
+// (returns 1 if successful; the accumulator is unchanged otherwise)
+
+int Accumulator::Load(FILE *f) {
+
+  char tag[8];
+  long nn;
+  double a, b, c, d;
+
+  if (fscanf(f,"%7s %ld %la %la %la %la",tag,&nn,&a,&b,&c,&d)!=6) return 0;
+  if ((strcmp(tag,ACC_TAG)!=0) || (nn<0)) return 0;
+  n=nn;
+  mean=a;
+  m2=b;
+  min=c;
+  max=d;
+  return 1;
+}
+
+// CLASS Accumulator: Writes the binary state (native byte order)
+
+void Accumulator::Write(FILE *f) {
+
+  fwrite(&n,sizeof(n),1,f);
+  fwrite(&mean,sizeof(mean),1,f);
+  fwrite(&m2,sizeof(m2),1,f);
+  fwrite(&min,sizeof(min),1,f);
+  fwrite(&max,sizeof(max),1,f);
+}
+
+// CLASS Accumulator: Reads the binary state (returns 1 if successful)
+
+int Accumulator::Read(FILE *f) {
+
+  int ok=1;
+
+  ok&=(fread(&n,sizeof(n),1,f)==1);
+  ok&=(fread(&mean,sizeof(mean),1,f)==1);
+  ok&=(fread(&m2,sizeof(m2),1,f)==1);
+  ok&=(fread(&min,sizeof(min),1,f)==1);
+  ok&=(fread(&max,sizeof(max),1,f)==1);
+  return ok;
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLASS Covariance
+/////////////////////////////////////////////////////////////////////
+// Count, means and co-moment (sum of products of deviations) of a
+// series of pairs (x,y), updated with Welford's recurrence and merged
+// exactly like Accumulator.
+/////////////////////////////////////////////////////////////////////
+
+class Covariance {
+
+  public:
+
+    // Methods
+
+    Covariance();                       // Constructor
+    void Reset();                       // Removes all pairs
+    void Add(double x, double y);       // New pair
+    void Merge(Covariance *c);          // Adds the pairs of c
+    long Count();                       // Returns # of pairs
+    double Comoment();                  // Returns sum of (x-mx)(y-my)
+    void Save(FILE *f);                 // Writes serialized form
+    int Load(FILE *f);                  // Reads serialized form (1: ok)
+    void Write(FILE *f);                // Writes binary state (checkpoint)
+    int Read(FILE *f);                  // Reads binary state (1: ok)
+
+  private:
+
+    // Private attributes
+
+    long n;                             // Number of pairs
+    double mx, my;                      // Mean values
+    double cxy;                         // Co-moment
+
+};
+
+// CLASS Covariance: Constructor
+
+Covariance::Covariance() {
+
+  Reset();
+}
+
+// CLASS Covariance: Removes all pairs
+
+void Covariance::Reset() {
+
+  n=0;
+  mx=0;
+  my=0;
+  cxy=0;
+}
+
+// CLASS Covariance: New pair (Welford)
+
+void Covariance::Add(double x, double y) {
+
+  double dx;
+
+  n++;
+  dx=x-mx;
+  mx+=dx/n;
+  my+=(y-my)/n;
+  cxy+=dx*(y-my);
+}
+
+// CLASS Covariance: Adds the pairs of c (Chan et al.)
+
+void Covariance::Merge(Covariance *c) {
+
+  double dx, dy;
+  long nt;
+
+  if (c->n==0) return;
+  if (n==0) {
+    *this=*c;
+    return;
+  }
+  nt=n+c->n;
+  dx=c->mx-mx;
+  dy=c->my-my;
+  cxy+=c->cxy+dx*dy*((double)n*c->n/nt);
+  mx+=dx*c->n/nt;
+  my+=dy*c->n/nt;
+  n=nt;
+}
+
+// CLASS Covariance: Returns the number of pairs
+
+long Covariance::Count() {
+
+  return n;
+}
+
+// CLASS Covariance: Returns the co-moment (n times the covariance)
+
+double Covariance::Comoment() {
+
+  return cxy;
+}
+
+// CLASS Covariance: Writes the serialized form
+// ("COV n mx my cxy", floats in hexadecimal)
+
+void Covariance::Save(FILE *f) {
+
+  fprintf(f,"%s %ld %a %a %a\n",COV_TAG,n,mx,my,cxy);
+}
+
+// CLASS Covariance: Reads the serialized form
+// (returns 1 if successful; the object is unchanged otherwise)
+
+int Covariance::Load(FILE *f) {
+
+  char tag[8];
+  long nn;
+  double a, b, c;
+
+  if (fscanf(f,"%7s %ld %la %la %la",tag,&nn,&a,&b,&c)!=5) return 0;
+  if ((strcmp(tag,COV_TAG)!=0) || (nn<0)) return 0;
+  n=nn;
+  mx=a;
+  my=b;
+  cxy=c;
+  return 1;
+}
+
+// CLASS Covariance: Writes the binary state (native byte order)
+
+void Covariance::Write(FILE *f) {
+
+  fwrite(&n,sizeof(n),1,f);
+  fwrite(&mx,sizeof(mx),1,f);
+  fwrite(&my,sizeof(my),1,f);
+  fwrite(&cxy,sizeof(cxy),1,f);
+}
+
+// CLASS Covariance: Reads the binary state (returns 1 if successful)
+
+int Covariance::Read(FILE *f) {
+
+  int ok=1;
+
+  ok&=(fread(&n,sizeof(n),1,f)==1);
+  ok&=(fread(&mx,sizeof(mx),1,f)==1);
+  ok&=(fread(&my,sizeof(my),1,f)==1);
+  ok&=(fread(&cxy,sizeof(cxy),1,f)==1);
+  return ok;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Small linear systems
+/////////////////////////////////////////////////////////////////////
+
+// Solves a.x=b (a: m*m, row-major) by Gaussian elimination with
+// partial pivoting; a is destroyed and b is replaced by x. Returns 1
+// if successful, 0 if a is singular.
+
+int Solve(double *a, double *b, int m) {
+
+  double t, f;
+  int i, j, k, p;
+
+  for (k=0; k<m; k++) {
+    p=k;
+    for (i=k+1; i<m; i++)
+      if (fabs(a[i*m+k])>fabs(a[p*m+k])) p=i;
+    if (fabs(a[p*m+k])<1e-300) return 0;
+    if (p!=k) {
+      for (j=0; j<m; j++) {
+        t=a[k*m+j];
+        a[k*m+j]=a[p*m+j];
+        a[p*m+j]=t;
+      }
+      t=b[k];
+      b[k]=b[p];
+      b[p]=t;
+    }
+    for (i=k+1; i<m; i++) {
+      f=a[i*m+k]/a[k*m+k];
+      for (j=k; j<m; j++) a[i*m+j]-=f*a[k*m+j];
+      b[i]-=f*b[k];
+    }
+  }
+  for (k=m-1; k>=0; k--) {
+    for (j=k+1; j<m; j++) b[k]-=a[k*m+j]*b[j];
+    b[k]/=a[k*m+k];
+  }
+  return 1;
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLASS TimeWeighted
+/////////////////////////////////////////////////////////////////////
+// Time average of a piecewise constant value (e.g. queue length):
+// the integral is updated at each change, in O(1).
+/////////////////////////////////////////////////////////////////////
+
+class TimeWeighted {
+
+  public:
+
+    // Methods
+
+    TimeWeighted();                     // Constructor
+    void Reset(double t, double v);     // Restarts at date t with value v
+    void Set(double t, double v);       // Value becomes v at date t
+    double Value();                     // Returns current value
+    double Mean(double t);              // Returns time average up to date t
+    void Write(FILE *f);                // Writes binary state (checkpoint)
+    int Read(FILE *f);                  // Reads binary state (1: ok)
+
+  private:
+
+    // Private attributes
+
+    double start;                       // Starting date
+    double last;                        // Date of last change
+    double value;                       // Current value
+    double integral;                    // Integral from start to last
+
+};
+
+// CLASS TimeWeighted: Constructor
+
+TimeWeighted::TimeWeighted() {
+
+  Reset(0,0);
+}
+
+// CLASS TimeWeighted: Restarts at date t with value v
+
+void TimeWeighted::Reset(double t, double v) {
+
+  start=t;
+  last=t;
+  value=v;
+  integral=0;
+}
+
+// CLASS TimeWeighted: Value becomes v at date t (t>=last change)
+
+void TimeWeighted::Set(double t, double v) {
+
+  integral+=value*(t-last);
+  last=t;
+  value=v;
+}
+
+// CLASS TimeWeighted: Returns the current value
+
+double TimeWeighted::Value() {
+
+  return value;
+}
+
+// CLASS TimeWeighted: Returns the time average up to date t
+// (the current value if no time has elapsed)
+
+double TimeWeighted::Mean(double t) {
+
+  if (t>start) return (integral+value*(t-last))/(t-start);
+  else return value;
+}
+
+// CLASS TimeWeighted: Writes the binary state (native byte order)
+
+void TimeWeighted::Write(FILE *f) {
+
+  fwrite(&start,sizeof(start),1,f);
+  fwrite(&last,sizeof(last),1,f);
+  fwrite(&value,sizeof(value),1,f);
+  fwrite(&integral,sizeof(integral),1,f);
+}
+
+// CLASS TimeWeighted: Reads the binary state (returns 1 if successful)
+
+int TimeWeighted::Read(FILE *f) {
+
+  int ok=1;
+
+  ok&=(fread(&start,sizeof(start),1,f)==1);
+  ok&=(fread(&last,sizeof(last),1,f)==1);
+  ok&=(fread(&value,sizeof(value),1,f)==1);
+  ok&=(fread(&integral,sizeof(integral),1,f)==1);
+  return ok;
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLASS Occupancy
+/////////////////////////////////////////////////////////////////////
+// Time spent in each state of an integer state variable (0..n-1;
+// other values are counted in the nearest state), updated in O(1).
+/////////////////////////////////////////////////////////////////////
+
+class Occupancy {
+
+  public:
+
+    // Methods
+
+    Occupancy(int n);                   // Constructor (n: number of states)
+    ~Occupancy();                       // Destructor
+    int States();                       // Returns number of states
+    int State();                        // Returns current state
+    void Reset(double t, int s);        // Restarts at date t in state s
+    void Set(double t, int s);          // State becomes s at date t
+    double Fraction(double t, int s);   // Returns fraction of time in s
+    void Write(FILE *f);                // Writes binary state (checkpoint)
+    int Read(FILE *f);                  // Reads binary state (1: ok)
+
+  private:
+
+    // Private attributes
+
+    int nstates;                        // Number of states
+    double *time;                       // Time spent in each state
+    double start;                       // Starting date
+    double last;                        // Date of last change
+    int state;                          // Current state
+
+};
+
+// CLASS Occupancy: Constructor
+
+Occupancy::Occupancy(int n) {
+
+  if (n<1) n=1;
+  nstates=n;
+  time=new double[nstates];
+  Reset(0,0);
+}
+
+// CLASS Occupancy: Destructor
+
+Occupancy::~Occupancy() {
+
+  delete[] time;
+}
+
+// CLASS Occupancy: Returns the number of states
+
+int Occupancy::States() {
+
+  return nstates;
+}
+
+// CLASS Occupancy: Returns the current state
+
+int Occupancy::State() {
+
+  return state;
+}
+
+// CLASS Occupancy: Restarts at date t in state s
+
+void Occupancy::Reset(double t, int s) {
+
+  int i;
+
+  for (i=0; i<nstates; i++) time[i]=0;
+  start=t;
+  last=t;
+  if (s<0) s=0;
+  if (s>=nstates) s=nstates-1;
+  state=s;
+}
+
+// CLASS Occupancy: State becomes s at date t (t>=last change)
+
+void Occupancy::Set(double t, int s) {
+
+  time[state]+=t-last;
+  last=t;
+  if (s<0) s=0;
+  if (s>=nstates) s=nstates-1;
+  state=s;
+}
+
+// CLASS Occupancy: Returns the fraction of time spent in state s up
+// to date t
+
+double Occupancy::Fraction(double t, int s) {
+
+  double d;
+
+  if ((s<0) || (s>=nstates)) return 0;
+  d=time[s];
+  if (s==state) d+=t-last;
+  if (t>start) return d/(t-start);
+  else return (s==state) ? 1 : 0;
+}
+
+// CLASS Occupancy: Writes the binary state (native byte order)
+
+void Occupancy::Write(FILE *f) {
+
+  fwrite(&nstates,sizeof(nstates),1,f);
+  fwrite(time,sizeof(double),nstates,f);
+  fwrite(&start,sizeof(start),1,f);
+  fwrite(&last,sizeof(last),1,f);
+  fwrite(&state,sizeof(state),1,f);
+}
+
+// CLASS Occupancy: Reads the binary state (returns 1 if successful,
+// 0 if the file is short or has another number of states)
+
+int Occupancy::Read(FILE *f) {
+
+  int ok=1, n;
+
+  if ((fread(&n,sizeof(n),1,f)!=1) || (n!=nstates)) return 0;
+  ok&=(fread(time,sizeof(double),nstates,f)==(size_t)nstates);
+  ok&=(fread(&start,sizeof(start),1,f)==1);
+  ok&=(fread(&last,sizeof(last),1,f)==1);
+  ok&=(fread(&state,sizeof(state),1,f)==1);
+  return ok;
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLASS Histogram
+/////////////////////////////////////////////////////////////////////
+// Log-linear histogram (as in HdrHistogram) of non-negative values.
+// A value v is counted as q=floor(v/unit); q<2*HIST_SUB is counted
+// exactly, larger q in HIST_SUB buckets per power of 2, so quantiles
+// are within 1/HIST_SUB (relative) or one unit. Octaves are allocated
+// on first use and kept by Reset(): memory is bounded (at most
+// HIST_OCTAVES*HIST_SUB counters) whatever the number of values.
+// Histograms of equal unit merge exactly (counters are added).
+/////////////////////////////////////////////////////////////////////
+
+class Histogram {
+
+  public:
+
+    // Methods
+
+    Histogram(double u=HIST_UNIT);      // Constructor (u: resolution)
+    ~Histogram();                       // Destructor
+    void Reset();                       // Removes all values
+    void Add(double v);                 // New value
+    void Merge(Histogram *h);           // Adds the values of h
+    long Count();                       // Returns # of values
+    double Mean();                      // Returns mean value
+    double Max();                       // Returns maximum value
+    double Quantile(double p);          // Returns p-quantile (0<=p<=1)
+    int Bins();                         // Returns # of non-empty buckets
+    void GetBins(int *index, long *counts); // Copies the non-empty buckets
+    void AddBins(int *index, long *counts, int n, double m); // Adds buckets
+    void Write(FILE *f);                // Writes binary state (checkpoint)
+    int Read(FILE *f);                  // Reads binary state (1: ok)
+
+  private:
+
+    // Internal methods
+
+    double Value(int oct, int sub);     // Representative value of a bucket
+
+    // Private attributes
+
+    double unit;                        // Resolution
+    long *octave[HIST_OCTAVES];         // Counters (NULL: not used yet)
+    long count;                         // Number of values
+    double sum;                         // Sum of values
+    double max;                         // Maximum value
+
+};
+
+// CLASS Histogram: Constructor
+
+Histogram::Histogram(double u) {
+
+  int i;
+
+  unit=u;
+  for (i=0; i<HIST_OCTAVES; i++) octave[i]=NULL;
+  count=0;
+  sum=0;
+  max=0;
+}
+
+// CLASS Histogram: Destructor
+
+Histogram::~Histogram() {
+
+  int i;
+
+  for (i=0; i<HIST_OCTAVES; i++) delete[] octave[i];
+}
+
+// CLASS Histogram: Removes all values (octaves are kept)
+
+void Histogram::Reset() {
+
+  int i;
+
+  for (i=0; i<HIST_OCTAVES; i++)
+    if (octave[i]!=NULL) memset(octave[i],0,HIST_SUB*sizeof(long));
+  count=0;
+  sum=0;
+  max=0;
+}
+
+// CLASS Histogram: New value (negative values count as 0)
+
+void Histogram::Add(double v) {
+
+  uint64_t q;
+  int oct, sub;
+
+  if (v<0) v=0;
+  if (v/unit>=18446744073709551615.0) q=~(uint64_t)0;
+  else q=(uint64_t)(v/unit);
+
+  if (q<HIST_SUB) {                     // Octave 0: exact
+    oct=0;
+    sub=(int)q;
+  } else {                              // Octave k: width 2^(k-1)
+    oct=63-__builtin_clzll(q)-HIST_SUBBITS+1;
+    sub=(int)(q>>(oct-1))-HIST_SUB;
+  }
+
+  if (octave[oct]==NULL) {
+    octave[oct]=new long[HIST_SUB];
+    memset(octave[oct],0,HIST_SUB*sizeof(long));
+  }
+  octave[oct][sub]++;
+
+  count++;
+  sum+=v;
+  if (v>max) max=v;
+}
+
+// CLASS Histogram: Adds the values of h (same unit)
+
+void Histogram::Merge(Histogram *h) {
+
+  int i, j;
+
+  for (i=0; i<HIST_OCTAVES; i++)
+    if (h->octave[i]!=NULL) {
+      if (octave[i]==NULL) {
+        octave[i]=new long[HIST_SUB];
+        memset(octave[i],0,HIST_SUB*sizeof(long));
+      }
+      for (j=0; j<HIST_SUB; j++) octave[i][j]+=h->octave[i][j];
+    }
+  count+=h->count;
+  sum+=h->sum;
+  if (h->max>max) max=h->max;
+}
+
+// CLASS Histogram: Returns the number of values
+
+long Histogram::Count() {
+
+  return count;
+}
+
+// CLASS Histogram: Returns the mean value (exact)
+
+double Histogram::Mean() {
+
+  if (count>0) return sum/count;
+  else return 0;
+}
+
+// CLASS Histogram: Returns the maximum value (exact)
+
+double Histogram::Max() {
+
+  return max;
+}
+
+// CLASS Histogram: Representative value of a bucket (middle)
+
+double Histogram::Value(int oct, int sub) {
+
+  double low, width;
+
+  if (oct==0) return sub*unit;
+  width=ldexp(1.0,oct-1);
+  low=(HIST_SUB+sub)*width;
+  return (low+(width-1)/2)*unit;
+}
+
+// CLASS Histogram: Returns the p-quantile (smallest bucket holding at
+// least p*Count() values; never above the maximum)
+
+double Histogram::Quantile(double p) {
+
+  long rank, cumul;
+  double v;
+  int i, j;
+
+  if (count==0) return 0;
+  if (p>=1) return max;
+  rank=(long)ceil(p*count);
+  if (rank<1) rank=1;
+
+  cumul=0;
+  for (i=0; i<HIST_OCTAVES; i++)
+    if (octave[i]!=NULL)
+      for (j=0; j<HIST_SUB; j++) {
+        cumul+=octave[i][j];
+        if (cumul>=rank) {
+          v=Value(i,j);
+          if (v>max) return max;
+          else return v;
+        }
+      }
+  return max;
+}
+
+// CLASS Histogram: Returns the number of non-empty buckets
+
+int Histogram::Bins() {
+
+  int i, j, n;
+
+  n=0;
+  for (i=0; i<HIST_OCTAVES; i++)
+    if (octave[i]!=NULL)
+      for (j=0; j<HIST_SUB; j++)
+        if (octave[i][j]!=0) n++;
+  return n;
+}
+
+// CLASS Histogram: Copies the non-empty buckets (Bins() of them) into
+// index (octave*HIST_SUB+sub-bucket) and counts, in increasing order
+
+void Histogram::GetBins(int *index, long *counts) {
+
+  int i, j, n;
+
+  n=0;
+  for (i=0; i<HIST_OCTAVES; i++)
+    if (octave[i]!=NULL)
+      for (j=0; j<HIST_SUB; j++)
+        if (octave[i][j]!=0) {
+          index[n]=i*HIST_SUB+j;
+          counts[n++]=octave[i][j];
+        }
+}
+
+// CLASS Histogram: Adds n buckets given by GetBins() on a histogram of
+// the same unit, whose maximum was m. Quantiles and the maximum are
+// then exact; the sum (Mean()) uses the buckets' representative values.
+
+void Histogram::AddBins(int *index, long *counts, int n, double m) {
+
+  int i, oct, sub;
+
+  for (i=0; i<n; i++) {
+    oct=index[i]/HIST_SUB;
+    sub=index[i]%HIST_SUB;
+    if (octave[oct]==NULL) {
+      octave[oct]=new long[HIST_SUB];
+      memset(octave[oct],0,HIST_SUB*sizeof(long));
+    }
+    octave[oct][sub]+=counts[i];
+    count+=counts[i];
+    sum+=Value(oct,sub)*counts[i];
+  }
+  if (m>max) max=m;
+}
+
+// CLASS Histogram: Writes the binary state (native byte order; only
+// octaves in use are written)
+
+void Histogram::Write(FILE *f) {
+
+  int i, used;
+
+  fwrite(&unit,sizeof(unit),1,f);
+  fwrite(&count,sizeof(count),1,f);
+  fwrite(&sum,sizeof(sum),1,f);
+  fwrite(&max,sizeof(max),1,f);
+  for (i=0; i<HIST_OCTAVES; i++) {
+    used=(octave[i]!=NULL);
+    fwrite(&used,sizeof(used),1,f);
+    if (used) fwrite(octave[i],sizeof(long),HIST_SUB,f);
+  }
+}
+
+// CLASS Histogram: Reads the binary state (returns 1 if successful)
+
+int Histogram::Read(FILE *f) {
+
+  int ok=1, i, used;
+
+  Reset();
+  ok&=(fread(&unit,sizeof(unit),1,f)==1);
+  ok&=(fread(&count,sizeof(count),1,f)==1);
+  ok&=(fread(&sum,sizeof(sum),1,f)==1);
+  ok&=(fread(&max,sizeof(max),1,f)==1);
+  for (i=0; (i<HIST_OCTAVES) && ok; i++) {
+    ok&=(fread(&used,sizeof(used),1,f)==1);
+    if (ok && used) {
+      if (octave[i]==NULL) octave[i]=new long[HIST_SUB];
+      ok&=(fread(octave[i],sizeof(long),HIST_SUB,f)==HIST_SUB);
+    }
+  }
+  return ok;
+}
+
+#endif
@@ -0,0 +1,83 @@
+/////////////////////////////////////////////////////////////////////
+// DESP-C++ (Discrete-Event Simulation Package)
+/////////////////////////////////////////////////////////////////////
+// simtime.h: Simulation clock type
+// Invariable
+/////////////////////////////////////////////////////////////////////
+// All dates and durations given to or returned by the engine
+// (Simulation, Scheduler, Resource) are SimTime's:
+//
+// - default:               double precision time units
+// - -DSIM_TIME_FLOAT:      single precision (DESP-C++ 1.1; dates
+//                          collapse past about 2^24 time units)
+// - -DSIM_TIME_TICKS=n:    64-bit integer ticks, n per time unit
+//                          (exact dates and ordering at any horizon)
+//
+// Ticks(x) converts x time units to a SimTime, Units(t) converts back
+// (both are the identity with floating point clocks). Variates drawn
+// with simutil.h are SimReal's: durations in time units, to be
+// converted with Ticks() before being added to a date.
+/////////////////////////////////////////////////////////////////////
+
+#ifndef SIMTIME_H
+#define SIMTIME_H
+
+// Includes
+
+#include <stdint.h>
+#include <math.h>
+
+/////////////////////////////////////////////////////////////////////
+// Constants and types
+/////////////////////////////////////////////////////////////////////
+
+#define TIME_FLOAT 0          // Clock kinds (see CheckpointHeader)
+#define TIME_DOUBLE 1
+#define TIME_TICKS 2
+
+#if defined(SIM_TIME_TICKS)
+typedef int64_t SimTime;                // Clock: integer ticks
+typedef double SimReal;                 // Durations in time units
+#define TIME_KIND TIME_TICKS
+#define TIME_NEVER INT64_MAX            // Date of what never happens
+#elif defined(SIM_TIME_FLOAT)
+typedef float SimTime;
+typedef float SimReal;
+#define TIME_KIND TIME_FLOAT
+#define SIM_TIME_TICKS 0
+#define TIME_NEVER HUGE_VAL
+#else
+typedef double SimTime;
+typedef double SimReal;
+#define TIME_KIND TIME_DOUBLE
+#define SIM_TIME_TICKS 0
+#define TIME_NEVER HUGE_VAL
+#endif
+
+/////////////////////////////////////////////////////////////////////
+// Conversions
+/////////////////////////////////////////////////////////////////////
+
+// x time units as a SimTime (ticks: rounded to the nearest tick)
+
+SimTime Ticks(double x) {
+
+#if TIME_KIND==TIME_TICKS
+  return (SimTime)llround(x*SIM_TIME_TICKS);
+#else
+  return (SimTime)x;
+#endif
+}
+
+// SimTime t in time units
+
+SimReal Units(SimTime t) {
+
+#if TIME_KIND==TIME_TICKS
+  return (SimReal)t/SIM_TIME_TICKS;
+#else
+  return t;
+#endif
+}
+
+#endif
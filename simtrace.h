@@ -0,0 +1,220 @@
+/////////////////////////////////////////////////////////////////////
+// DESP-C++ (Discrete-Event Simulation Package)
+/////////////////////////////////////////////////////////////////////
+// simtrace.h: Binary event trace
+// Invariable
+/////////////////////////////////////////////////////////////////////
+// File layout: one TraceHeader, then fixed-size TraceRecord's (native
+// byte order), one per executed event. Records are appended to one of
+// two buffers; full buffers are written by a background thread, so
+// the simulation thread never formats nor blocks on I/O (unless the
+// disk falls behind by more than one buffer).
+// tracedump.cc converts a trace to text or CSV.
+/////////////////////////////////////////////////////////////////////
+
+// Includes
+
+#include <stdio.h>
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "simlog.h"
+
+/////////////////////////////////////////////////////////////////////
+// Constants
+/////////////////////////////////////////////////////////////////////
+
+#define TRACE_MAGIC 0x45435254 // "TRCE"
+#define TRACE_VERSION 1       // Format version
+#define TRACE_BLOCK 8192      // Records per buffer
+
+/////////////////////////////////////////////////////////////////////
+// Trace file structures
+/////////////////////////////////////////////////////////////////////
+
+struct TraceHeader {
+  uint32_t magic;                       // TRACE_MAGIC
+  uint32_t version;                     // TRACE_VERSION
+  uint32_t recsize;                     // sizeof(TraceRecord)
+  uint32_t reserved;                    // 0
+};
+
+struct TraceRecord {
+  double date;                          // Event date
+  int32_t code;                         // Event code
+  int32_t client;                       // Client id
+  int32_t resource;                     // Resource id (-1: none)
+  int32_t replic;                       // Replication number
+};
+
+/////////////////////////////////////////////////////////////////////
+// CLASS TraceWriter
+/////////////////////////////////////////////////////////////////////
+// Buffered, background-flushed trace sink
+/////////////////////////////////////////////////////////////////////
+
+class TraceWriter {
+
+  public:
+
+    // Methods
+
+    TraceWriter(const char *filename);  // Constructor (opens file)
+    ~TraceWriter();                     // Destructor (flushes, closes)
+    int IsOpen();                       // 1 if file could be opened
+    void Write(double date, int code, int client, int resource, int replic); // New record
+    void Flush();                       // Writes all pending records
+    long Records();                     // Returns # of records written
+
+  private:
+
+    // Internal methods
+
+    void Swap();                        // Hands current buffer over
+    void Background();                  // Writer thread body
+
+    // Private attributes
+
+    FILE *file;                         // Trace file
+    TraceRecord *buf[2];                // Double buffer
+    int cur;                            // Buffer being filled
+    int fill;                           // Records in current buffer
+    int pending;                        // Buffer to write (-1: none)
+    int pendingcount;                   // Records in pending buffer
+    int done;                           // 1 when writer must stop
+    long nrec;                          // Records written
+    std::thread *writer;                // Writer thread
+    std::mutex lock;                    // Protects pending and done
+    std::condition_variable cv;         // Signals pending changes
+
+};
+
+// CLASS TraceWriter: Constructor
+
+TraceWriter::TraceWriter(const char *filename) {
+
+  TraceHeader h;
+
+  cur=0;
+  fill=0;
+  pending=-1;
+  pendingcount=0;
+  done=0;
+  nrec=0;
+  buf[0]=NULL;
+  buf[1]=NULL;
+  writer=NULL;
+
+  file=fopen(filename,"wb");
+  if (file==NULL) {
+    LogError("Error: cannot open trace file %s\n",filename);
+    return;
+  }
+  h.magic=TRACE_MAGIC;
+  h.version=TRACE_VERSION;
+  h.recsize=sizeof(TraceRecord);
+  h.reserved=0;
+  fwrite(&h,sizeof(h),1,file);
+
+  buf[0]=new TraceRecord[TRACE_BLOCK];
+  buf[1]=new TraceRecord[TRACE_BLOCK];
+  writer=new std::thread(&TraceWriter::Background,this);
+}
+
+// CLASS TraceWriter: Destructor
+
+TraceWriter::~TraceWriter() {
+
+  if (file==NULL) return;
+
+  Flush();
+  {
+    std::unique_lock<std::mutex> l(lock);
+    done=1;
+  }
+  cv.notify_all();
+  writer->join();
+  delete writer;
+  fclose(file);
+  delete[] buf[0];
+  delete[] buf[1];
+}
+
+// CLASS TraceWriter: Returns file state
+// (1 if open, 0 if not)
+
+int TraceWriter::IsOpen() {
+
+  if (file!=NULL) return 1;
+  else return 0;
+}
+
+// CLASS TraceWriter: New record
+
+void TraceWriter::Write(double date, int code, int client, int resource, int replic) {
+
+  TraceRecord *r;
+
+  if (file==NULL) return;
+
+  r=buf[cur]+fill;
+  r->date=date;
+  r->code=code;
+  r->client=client;
+  r->resource=resource;
+  r->replic=replic;
+  nrec++;
+  if (++fill==TRACE_BLOCK) Swap();
+}
+
+// CLASS TraceWriter: Hands the current buffer to the writer thread
+
+void TraceWriter::Swap() {
+
+  std::unique_lock<std::mutex> l(lock);
+
+  cv.wait(l,[this]{ return pending<0; });
+  pending=cur;
+  pendingcount=fill;
+  cv.notify_all();
+  cur^=1;
+  fill=0;
+}
+
+// CLASS TraceWriter: Writes all pending records (waits for the disk)
+
+void TraceWriter::Flush() {
+
+  if (file==NULL) return;
+
+  if (fill>0) Swap();
+  std::unique_lock<std::mutex> l(lock);
+  cv.wait(l,[this]{ return pending<0; });
+  fflush(file);
+}
+
+// CLASS TraceWriter: Returns the number of records written
+
+long TraceWriter::Records() {
+
+  return nrec;
+}
+
+// CLASS TraceWriter: Writer thread body
+
+void TraceWriter::Background() {
+
+  std::unique_lock<std::mutex> l(lock);
+
+  while (1) {
+    cv.wait(l,[this]{ return (pending>=0) || done; });
+    if (pending>=0) {
+      l.unlock();
+      fwrite(buf[pending],sizeof(TraceRecord),pendingcount,file);
+      l.lock();
+      pending=-1;
+      cv.notify_all();
+    } else if (done) break;
+  }
+}
@@ -9,21 +9,167 @@
 // Invariable
 /////////////////////////////////////////////////////////////////////
 
+/////////////////////////////////////////////////////////////////////
+// Includes
+/////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include "simtrace.h"
+#include "simstat.h"
+#include "simtime.h"
+
+class Arena;
 class Simulation;
 class Scheduler;
 class SchedulerCell;
+class EventList;
 class Resource;
-class QueueCell;
+class Sweep;
+struct QueueCell;
 
 class EventManager; // Defined in the eventc.hh variable module
 class Client;       // Defined in the eventc.hh variable module
 
+/////////////////////////////////////////////////////////////////////
+// TEMPLATE EventHandler
+/////////////////////////////////////////////////////////////////////
+// Handler of event #code. Only declared here: the variable module
+// specializes it for each event of the model with
+//   static void Execute(Client *client, Resource *res);
+// res is the resource the event was scheduled on (NULL if none).
+// Events are only scheduled through Schedule<code>() and P<code>():
+// an event that has no handler does not compile.
+/////////////////////////////////////////////////////////////////////
+
+template <int code> struct EventHandler;
+
+typedef void (*EventFunction)(Client *client, Resource *res);
+
+// Dispatch table: EventTable<n>::Fill(table) sets table[0..n-1] to
+// the handlers of events 0..n-1 (each one must exist).
+
+template <int n> struct EventTable {
+  static void Fill(EventFunction *table) {
+    EventTable<n-1>::Fill(table);
+    table[n-1]=&EventHandler<n-1>::Execute;
+  }
+};
+
+template <> struct EventTable<0> {
+  static void Fill(EventFunction *) {}
+};
+
 /////////////////////////////////////////////////////////////////////
 // Constants
 /////////////////////////////////////////////////////////////////////
 
 #define STRS 25               // Resources' names size
 #define DEFAULT_SEED 127      // Default random seed
+#define MAX_STATES 16         // Tracked states per resource (TrackState)
+#define STAT_OCC 16           // First occupancy statistic
+#define MAX_CONTROLS 4        // Control variates per resource (AddControl)
+#define STAT_CTRL (STAT_OCC+MAX_STATES) // First control variate statistic
+#define NSTATS (STAT_CTRL+MAX_CONTROLS) // Statistics per resource and replication
+#define MAX_TARGETS 16        // Stopping targets (sequential mode)
+#define PRIORITIES 64         // Resource queue priorities (0..63)
+#define SEQ_MIN 10            // Minimum replications (sequential mode)
+#define CKPT_MAGIC 0x54504B43 // Checkpoint files: "CKPT"
+#define CKPT_VERSION 6        // Checkpoint format version
+#define CKPT_EVENTS 4096      // Events between two wall clock readings
+#define MAX_OUTPUTS 16        // Output columns of a sweep
+#define MAX_STREAMS 8         // Random streams per simulation (see Rng(k))
+#define BATCH_BASE 256        // Base batches of a batch means run (by time)
+#define BATCH_MIN 10          // Minimum number of batch means
+#define MAX_RESOURCES 32767   // Resource ids (EventRecord::resource)
+#define MAX_EVENTS 65536      // Event codes (EventRecord::code)
+
+// Future event list implementations (see Scheduler constructor)
+
+#define FEL_LIST 0            // Sorted doubly linked list (linear insert)
+#define FEL_HEAP 1            // Binary heap
+#define FEL_HEAP4 2           // 4-ary heap
+#define FEL_CALENDAR 3        // Calendar queue (Brown, 1988)
+#define FEL_LADDER 4          // Ladder queue (Tang, Goh & Thng, 2005)
+
+// Event dispatch (see Simulation::SetDispatch)
+
+#define DISPATCH_TABLE 0      // EventManager::ExecuteEvent (handler table)
+#define DISPATCH_SWITCH 1     // EventManager::SwitchEvent (switch)
+
+// Arena object types (one free list per type)
+
+#define ARENA_CELL 0          // SchedulerCell
+#define ARENA_CLIENT 1        // Client
+#define ARENA_TYPES 2         // Number of types
+#define ARENA_CHUNK 65536     // Arena chunk size (bytes)
+
+/////////////////////////////////////////////////////////////////////
+// CLASS Arena
+/////////////////////////////////////////////////////////////////////
+// Replication-scoped memory: objects are popped from a per-type free
+// list or bumped from the current chunk. Release() gives back the
+// whole replication at once; chunks are kept for the next one, so a
+// steady-state replication does not touch the heap at all.
+/////////////////////////////////////////////////////////////////////
+
+class Arena {
+
+  public:
+
+    // Methods
+
+    Arena();                            // Constructor
+    ~Arena();                           // Destructor
+    void *Alloc(int type, size_t size); // Object allocation
+    void Free(int type, void *obj);     // Object release (to free list)
+    void Release();                     // Releases all objects
+    long Allocs(int type);              // Returns # of allocations of type
+    long HeapAllocs();                  // Returns # of chunks taken from heap
+
+  private:
+
+    // Private attributes
+
+    char *first;                        // First chunk
+    char *chunk;                        // Current chunk
+    char *ptr;                          // Bump pointer in current chunk
+    char *end;                          // End of current chunk
+    void *freelist[ARENA_TYPES];        // Free lists
+    long nalloc[ARENA_TYPES];           // Allocation counters
+    long nheap;                         // Heap allocation counter
+
+};
+
+// Stopping target of the sequential mode (see AddTarget)
+
+struct Target {
+  int resource;                         // Resource number (GetResource)
+  short stat;                           // Statistic number (0..NSTATS-1)
+  double halfwidth;                     // Maximum half-width
+  int relative;                         // 1 if relative to |mean|
+};
+
+// Checkpoint file header (see Simulation::Checkpoint). It is followed
+// by the engine state, the random generators' state (with their
+// buffered variates), the clients, the future event list and the
+// state of each resource, with its statistics of past replications in
+// checkpoints (not in warm-up snapshots). Native byte order: a
+// checkpoint is restored on the machine that wrote it.
+
+struct CheckpointHeader {
+  uint32_t magic;                       // CKPT_MAGIC
+  uint32_t version;                     // CKPT_VERSION
+  uint32_t clientsize;                  // sizeof(Client)
+  uint32_t nstats;                      // NSTATS
+  uint32_t priorities;                  // PRIORITIES
+  int32_t nresources;                   // Resource ids given
+  int32_t genkind;                      // Random generator kind
+  uint32_t totals;                      // 1 if past replications' stats follow
+  uint32_t timekind;                    // TIME_KIND (see simtime.h)
+  uint32_t ticks;                       // SIM_TIME_TICKS (0: floating point clock)
+};
 
 /////////////////////////////////////////////////////////////////////
 // CLASS Simulation
@@ -37,35 +183,152 @@ class Simulation {
 
     // Methods
 
-    Simulation(float start, float max, long int seed); // Constructor
+    Simulation(SimTime start, SimTime max, long int seed, int fel=FEL_HEAP4,
+               int gen=RNG_LEWIS);      // Constructor
     ~Simulation();                      // Destructor
     void Run(int nreplic);              // Simulation execution
+    long Events();                      // Returns # of events executed
+    void RunParallel(int nreplic, int nthreads); // Multi-threaded execution
+    int AddTarget(int res, short stat, double halfwidth,
+                  int relative=0);      // New stopping target
+    int RunSequential(int maxreplic, int nthreads=1,
+                      int batch=0);     // Runs until targets are met
     Scheduler *Sched();                 // Returns scheduler address
-    float Tnow();                       // Returns tnow
-    float Tmax();                       // Returns tmax
-    void Reset(float start, float max, long int seed); // Reinitialization
+    SimTime Tnow();                     // Returns tnow
+    SimTime Tmax();                     // Returns tmax
+    void Reset(SimTime start, SimTime max, long int seed); // Reinitialization
     Client *NewClient();                // Creates a client in clientlist
     void KillClient(Client *client);    // Deletes a client in clientlist
     void PurgeClientList();             // Deletes all clients
+    Arena *Mem();                       // Returns replication arena
+    int Register(Resource *res);        // Registers a resource, returns its id
+    void Unregister(int id);            // Removes a resource from registry
+    int NbResources();                  // Returns # of resource ids
+    Resource *GetResource(int id);      // Returns resource #id (NULL: none)
+    void SetTrace(TraceWriter *tw);     // Binary trace (NULL: none)
+    void SetDispatch(int mode);         // Event dispatch (DISPATCH_*)
+    RandomStream *Rng();                // Returns random generator
+    RandomStream *Rng(int k);           // Returns random stream #k (0: Rng())
+    VariateStream *Variates(int k);     // Returns buffered variates of stream #k
+    EventManager *Manager();            // Returns event manager (model)
+    int Checkpoint(const char *filename); // Writes engine state (1: ok)
+    int Restore(const char *filename);  // Reads engine state (1: ok)
+    void SetCheckpoint(const char *filename, double wallperiod,
+                       SimTime simperiod); // Periodic checkpoints (Run)
+    int Resume(const char *filename, int nreplic); // Run from a checkpoint
+    void SetWarmup(SimTime length);     // Warm-up (deletion) period
+    void RunWarmStart(int nreplic);     // Replications forked after one warm-up
+    void RunBatchMeans(int clients=0, int overlap=0); // One long run (batch means)
 
   private:
 
+    // Internal methods
+
+    void Attach(Client *client);        // Gives client an event handle
+    void Replicate();                   // Runs one replication
+    void Engine();                      // Executes events up to tmax
+    template <int mode> void Loop();    // Engine() for dispatch mode
+    void Replications(int first, int nreplic, int charcount,
+                      int resumed);     // Run() loop from replication first
+    int CheckpointDue();                // 1 if a periodic checkpoint is due
+    int Save(FILE *f, int totals);      // Writes engine state (1: ok)
+    int Load(FILE *f, const char *name, int totals); // Reads engine state (1: ok)
+    void Truncate();                    // Deletes stats gathered so far (warm-up)
+    void Fork(int i);                   // Replication #i from warm-up snapshot
+    void Substream(long i, int anti);   // All streams to substream i
+    void Rebind();                      // Buffered variates to current streams
+    void RunBatch(int first, int count, int nthreads, int *charcount); // Parallel batch
+    void Worker(int first, int last, std::atomic<int> *next, double *samples,
+                std::mutex *lock);      // Thread body
+    int TargetsMet();                   // 1 if all targets are met
+
     // Private attributes
 
-    float tstart;                       // Simulation starting time
-    float tmax;                         // Simulation ending time
-    float tnow;                         // Current date
+    SimTime tstart;                     // Simulation starting time
+    SimTime tmax;                       // Simulation ending time
+    SimTime tnow;                       // Current date
+    SimTime warmup;                     // Warm-up period length
+    SimTime twarm;                      // End of warm-up (stats deletion)
     long int rseed;                     // Random generator seed
+    RandomStream *rng;                  // Random generator (stream 0)
+    RandomStream *streams[MAX_STREAMS]; // Random streams (created on first use)
+    RandomStream *mirrors[MAX_STREAMS]; // Antithetic views of streams
+    RandomStream *current[MAX_STREAMS]; // Streams or views given by Rng(k)
+    VariateStream *variates[MAX_STREAMS]; // Buffered variates (created on first use)
+    long cursub;                        // Current substream (-1: none)
+    int antithetic;                     // 1 if draws are antithetic (1-u)
+    int genkind;                        // Random generator kind
+    long nevents;                       // Number of events executed
+    int nclients;                       // Clients created (replication)
+    int nresources;                     // Resources created
+    Resource **registry;                // Resources by id
+    int registrycapacity;               // Allocated size of registry
+    int replic;                         // Current replication
+    TraceWriter *trace;                 // Binary trace
+    Target targets[MAX_TARGETS];        // Stopping targets
+    int ntargets;                       // Number of stopping targets
+    int felkind;                        // Future event list implementation
+    int dispatch;                       // Event dispatch (DISPATCH_*)
     Client *clientlist;                 // Clients list
+    Client **handles;                   // Clients by event handle (0: none)
+    int *freehandles;                   // Handles of killed clients (stack)
+    int nhandles, nfree;                // Handles given - Free handles
+    int handlecapacity;                 // Allocated size of handles
+    Arena *arena;                       // Replication arena
     Scheduler *scheduler;               // Pointer toward scheduler
     EventManager *eventmanager;         // Pointer toward event manager
+    const char *ckptfile;               // Periodic checkpoint file (NULL: none)
+    double ckptwall;                    // Wall time period (s, 0: none)
+    SimTime ckptsim;                    // Simulated time period (0: none)
+    SimTime ckptnext;                   // Date of next checkpoint
+    std::chrono::steady_clock::time_point ckptlast; // Last checkpoint (wall)
+    FILE *snapshot;                     // Warm-up snapshot (NULL: none)
+    SimTime batchlength;                // Base batch length (0: none)
+    int batchclients;                   // Clients per base batch (0: none)
+    int batchnext;                      // Client closing the base batch (0: none)
+    int batchcount;                     // Base batches closed (-1: warm-up)
+
+    friend class Sweep;                 // Copies settings, runs replications
+
+};
+
+// Pending event, as taken out by Scheduler::PopNext(). Packed in 16
+// bytes (12 with a float clock): the client is given by its handle in
+// the simulation's client table, not by a pointer.
+
+struct EventRecord {
+  SimTime date;                         // Event date
+  uint16_t code;                        // Event code (< MAX_EVENTS)
+  int16_t resource;                     // Resource id (-1: none)
+  uint32_t client;                      // Client handle (0: none)
+};
+
+static_assert(sizeof(EventRecord)<=16,"EventRecord must fit in 16 bytes");
+
+// Event of the future event list: the record and its sequence number
+// (FIFO tie-break between events at the same date). Heaps hold them
+// by value, linked lists inside a SchedulerCell.
 
+struct PendingEvent {
+  EventRecord rec;                      // Event
+  unsigned long seq;                    // Sequence number
 };
 
 /////////////////////////////////////////////////////////////////////
 // CLASS Scheduler
 /////////////////////////////////////////////////////////////////////
-// Scheduler (sorted event list)
+// Scheduler (future event list front-end)
+/////////////////////////////////////////////////////////////////////
+// Events are kept in an EventList chosen at construction time. Each
+// event receives a sequence number so that events scheduled at the
+// same date are always executed in insertion (FIFO) order, whatever
+// the underlying structure. Events are handed to the list by value;
+// the linked structures copy them into cells of the simulation arena.
+// Zero-delay events (scheduled at the date of the last event taken
+// out, e.g. by Resource::P and V) bypass the sorted list: their
+// records are appended by value to a FIFO ring, whose head competes
+// with the list's top in O(1). The execution order is unchanged.
+// PopNext() takes the next event out as a whole record.
 /////////////////////////////////////////////////////////////////////
 
 class Scheduler {
@@ -74,22 +337,39 @@ class Scheduler {
 
     // Methods
 
-    Scheduler();                        // Constructor
+    Scheduler(Arena *mem, int fel=FEL_HEAP4); // Constructor
     ~Scheduler();                       // Destructor
     int IsEmpty();                      // Returns scheduler state
-    void Schedule(int eventcode, float eventdate, Client *client); // Insert
-    int GetEventCode();                 // Returns next event code
-    float GetEventDate();               // Returns next event date
-    Client *GetClient();                // Returns client to "serve"
-    void DestroyEvent();                // Deletes next event
+    template <int code> void Schedule(SimTime eventdate, Client *client,
+                                      int res=-1); // Insert (res: resource id)
+    int PopNext(EventRecord *ev);       // Takes next event out (0: none)
     void Purge();                       // Deteles all events
+    void Write(FILE *f, Client **byhandle); // Writes events (checkpoint)
+    int Read(FILE *f, Client **byid, int n); // Reads events (1: ok)
+    long Scheduled();                   // Returns # of events scheduled
+    long Immediate();                   // Returns # of them through the ring
 
   private:
 
+    // Internal methods
+
+    void Schedule(int eventcode, SimTime eventdate, Client *client,
+                  int res);             // Insert of any code
+    void WriteRecord(FILE *f, EventRecord *ev, unsigned long s,
+                     Client **byhandle); // Writes one event
+
     // Private attributes
 
-    SchedulerCell *top;                 // Pointer toward 1st (next) event
-    SchedulerCell *bottom;              // Pointer toward last event
+    EventList *list;                    // Future event list
+    unsigned long seq;                  // Next sequence number
+    SimTime current;                    // Date of the last event taken out
+    EventRecord *ring;                  // Zero-delay events (circular buffer)
+    unsigned long *ringseq;             // Their sequence numbers
+    int ringhead, ringcount;            // Index of 1st event - Number of events
+    int ringcapacity;                   // Allocated events (power of 2)
+    long nscheduled, nimmediate;        // Events scheduled - Through the ring
+
+    friend class Resource;              // Schedules queued events (V)
 
 };
 
@@ -105,10 +385,10 @@ class SchedulerCell {
 
     // Methods
 
-    SchedulerCell(int code, float date, Client *cli); // Constructor
-    int Code();                         // Returns event code
-    float Date();                       // Returns event date
-    Client *Cli();                      // Returns client served
+    SchedulerCell(PendingEvent *ev);    // Constructor
+    SimTime Date();                     // Returns event date
+    PendingEvent *Event();              // Returns event
+    int Precedes(SchedulerCell *cell);  // 1 if executed before cell
     SchedulerCell *Next();              // Returns next cell
     SchedulerCell *Previous();          // Returns previous cell
     void SetNext(SchedulerCell *newnext); // New next cell
@@ -118,14 +398,224 @@ class SchedulerCell {
 
     // Private attributes
 
-    int eventcode;                      // Event code
-    float eventdate;                    // Event date
-    Client *client;                     // Client served
+    PendingEvent ev;                    // Event (first: read with the links)
     SchedulerCell *next;                // Next cell
     SchedulerCell *previous;            // Previous cell
 
 };
 
+/////////////////////////////////////////////////////////////////////
+// CLASS EventList
+/////////////////////////////////////////////////////////////////////
+// Future event list interface. Events are ordered by date, then by
+// sequence number. Lists made of cells take them from the Scheduler's
+// arena: Purge() only drops them.
+/////////////////////////////////////////////////////////////////////
+
+class EventList {
+
+  public:
+
+    // Methods
+
+    virtual ~EventList();               // Destructor
+    virtual int IsEmpty()=0;            // Returns list state
+    virtual void Insert(PendingEvent *ev)=0; // Insertion (copy of *ev)
+    virtual PendingEvent *Top()=0;      // Returns next event (NULL if empty)
+    virtual void RemoveTop()=0;         // Deletes next event
+    virtual void Purge()=0;             // Deletes all events
+
+};
+
+/////////////////////////////////////////////////////////////////////
+// CLASS ListEventList
+/////////////////////////////////////////////////////////////////////
+// Sorted doubly linked list, insertion from the bottom: O(n) insert,
+// O(1) removal. Best for very short lists.
+/////////////////////////////////////////////////////////////////////
+
+class ListEventList: public EventList {
+
+  public:
+
+    // Methods
+
+    ListEventList(Arena *mem);          // Constructor (mem: cells' arena)
+    ~ListEventList();                   // Destructor
+    int IsEmpty();                      // Returns list state
+    void Insert(PendingEvent *ev);      // Insertion
+    PendingEvent *Top();                // Returns next event
+    void RemoveTop();                   // Deletes next event
+    void Purge();                       // Drops all cells
+
+  private:
+
+    // Private attributes
+
+    Arena *arena;                       // Cells' arena
+    SchedulerCell *top;                 // Pointer toward 1st (next) event
+    SchedulerCell *bottom;              // Pointer toward last event
+
+};
+
+/////////////////////////////////////////////////////////////////////
+// CLASS HeapEventList
+/////////////////////////////////////////////////////////////////////
+// Implicit d-ary heap (d=2 or d=4): O(log n) insert and removal.
+// Events are held by value in the heap array (no cells).
+/////////////////////////////////////////////////////////////////////
+
+class HeapEventList: public EventList {
+
+  public:
+
+    // Methods
+
+    HeapEventList(int d);               // Constructor (d: arity)
+    ~HeapEventList();                   // Destructor
+    int IsEmpty();                      // Returns list state
+    void Insert(PendingEvent *ev);      // Insertion
+    PendingEvent *Top();                // Returns next event
+    void RemoveTop();                   // Deletes next event
+    void Purge();                       // Deletes all events
+
+  private:
+
+    // Private attributes
+
+    int arity;                          // Number of children per node
+    int size;                           // Number of events
+    int capacity;                       // Allocated size of heap
+    PendingEvent *heap;                 // Heap array
+
+};
+
+/////////////////////////////////////////////////////////////////////
+// CLASS CalendarEventList
+/////////////////////////////////////////////////////////////////////
+// Calendar queue: array of sorted buckets ("days") of a given width,
+// resized when the population doubles or halves. O(1) expected
+// insert and removal when event dates are evenly spread.
+/////////////////////////////////////////////////////////////////////
+
+class CalendarEventList: public EventList {
+
+  public:
+
+    // Methods
+
+    CalendarEventList(Arena *mem);      // Constructor (mem: cells' arena)
+    ~CalendarEventList();               // Destructor
+    int IsEmpty();                      // Returns list state
+    void Insert(PendingEvent *ev);      // Insertion
+    PendingEvent *Top();                // Returns next event
+    void RemoveTop();                   // Deletes next event
+    void Purge();                       // Drops all cells
+
+  private:
+
+    // Internal methods
+
+    long long Day(double date);         // Returns day number of date
+    SchedulerCell *First();             // Returns next cell
+    void Link(SchedulerCell *cell);     // Insertion into its bucket
+    void Locate(double date);           // Sets current day for date
+    void Resize(int newsize);           // Rebuilds the calendar
+
+    // Private attributes
+
+    Arena *arena;                       // Cells' arena
+    SchedulerCell **bucket;             // Buckets (sorted lists)
+    int nbuckets;                       // Number of buckets
+    int bucketcapacity;                 // Allocated buckets
+    int size;                           // Number of cells
+    double width;                       // Bucket width (length of a day)
+    int lastbucket;                     // Current bucket
+    long long lastday;                  // Current day
+    double lastdate;                    // Date of last removed cell
+    SchedulerCell *cache;               // Next cell (NULL if unknown)
+    int cachebucket;                    // Bucket holding cache
+    long long cacheday;                 // Day of cache
+    SchedulerCell **sortbuf;            // Resize buffer
+    int sortcapacity;                   // Resize buffer size
+
+};
+
+/////////////////////////////////////////////////////////////////////
+// CLASS LadderEventList
+/////////////////////////////////////////////////////////////////////
+// Ladder queue: unsorted top list, a ladder of bucket rungs that are
+// refined on demand and a short sorted bottom list. O(1) amortized
+// insert and removal, robust to skewed date distributions.
+/////////////////////////////////////////////////////////////////////
+
+#define LADDER_RUNGS 8                  // Maximum number of rungs
+#define LADDER_THRES 50                 // Bucket size triggering a new rung
+
+class LadderEventList: public EventList {
+
+  public:
+
+    // Methods
+
+    LadderEventList(Arena *mem);        // Constructor (mem: cells' arena)
+    ~LadderEventList();                 // Destructor
+    int IsEmpty();                      // Returns list state
+    void Insert(PendingEvent *ev);      // Insertion
+    PendingEvent *Top();                // Returns next event
+    void RemoveTop();                   // Deletes next event
+    void Purge();                       // Drops all cells
+
+  private:
+
+    // Internal methods
+
+    void Prepare();                     // Fills bottom if empty
+    void Spawn(SchedulerCell *list, int count, double start, double w); // New rung
+    void Sort(SchedulerCell *list, int count); // Sorted list -> bottom
+    void BottomInsert(SchedulerCell *cell); // Sorted insertion into bottom
+    int Index(int r, double date);      // Bucket of date in rung r
+
+    // Private attributes
+
+    Arena *arena;                       // Cells' arena
+    SchedulerCell *toplist;             // Top (unsorted)
+    int topcount;                       // Number of cells in top
+    double topmin, topmax;              // Date range in top
+    double topstart;                    // Lower bound of top dates
+    int nrungs;                         // Number of rungs in use
+    SchedulerCell **rung[LADDER_RUNGS]; // Rungs' buckets (unsorted)
+    int *rcount[LADDER_RUNGS];          // Rungs' bucket sizes
+    int rsize[LADDER_RUNGS];            // Rungs' number of buckets
+    int rcapacity[LADDER_RUNGS];        // Rungs' allocated buckets
+    double rstart[LADDER_RUNGS];        // Rungs' starting dates
+    double rwidth[LADDER_RUNGS];        // Rungs' bucket widths
+    int rcur[LADDER_RUNGS];             // Rungs' current buckets
+    SchedulerCell *bottom;              // Bottom (sorted) first cell
+    SchedulerCell *bottomlast;          // Bottom last cell
+    int size;                           // Number of cells
+    SchedulerCell **sortbuf;            // Sort buffer
+    int sortcapacity;                   // Sort buffer size
+
+};
+
+/////////////////////////////////////////////////////////////////////
+// Resource queue structures
+/////////////////////////////////////////////////////////////////////
+
+struct QueueCell {
+  int code;                             // Event code
+  SimTime date;                         // Enqueue date
+  Client *client;                       // Client
+};
+
+struct PriorityRing {
+  QueueCell *cells;                     // Circular buffer (NULL: not used yet)
+  int head;                             // Index of 1st cell
+  int count;                            // Number of cells
+  int capacity;                         // Allocated cells (power of 2)
+};
+
 /////////////////////////////////////////////////////////////////////
 // CLASS Resource
 /////////////////////////////////////////////////////////////////////
@@ -139,79 +629,191 @@ class Resource {
     // Public methods
 
     Resource(char n[STRS], int cap, Simulation *sim); // Constructor
-    ~Resource();                        // Destructor
+    virtual ~Resource();                // Destructor
     void PurgeQueue();                  // Empties queue
-    void P(int event, Client *client, int prior); // Reserves resource
+    template <int code> void P(Client *client, int prior); // Reserves resource
     void V();                           // Frees ressource
+    void V(Client *client);             // Frees ressource (client leaves)
     Simulation *Sim();                  // Returns simulation object address
     void ResetCounters();               // Counters reinitialization
     void ResetStats();                  // Global stats reinitialization
     void Stats();                       // Stats computation
+    void Sample(double s[NSTATS]);      // Stats of current replication
+    void Accumulate(double s[NSTATS]);  // Adds replication stats
+    Accumulator *Acc(short i);          // Returns stats accumulator #i
+    double HalfWidth(short i);          // Returns stats conf. interval #i
+    void TrackState(int nstates);       // Tracks occupancy of states 0..nstates-1
+    void SetState(int state);           // Tracked state changes (at Tnow)
+    int AddControl(const char *n, double mu); // New control variate (known mean mu)
+    void SetControl(int c, double mu);  // Control variate #c known mean
+    void Observe(int c, double x);      // Control variate #c observation
+    double Adjusted(short i, double *hw); // Stats #i adjusted by the controls
+    void SaveStats(FILE *f);            // Writes accumulated stats
+    int LoadStats(FILE *f);             // Adds stats written by SaveStats
+    void Collect();                     // Adds replication histograms
+    void MergeHistograms(Resource *r);  // Adds r's histograms (all replications)
+    Histogram *Waits();                 // Waiting times (all replications)
+    Histogram *Sojourns();              // Sojourn times, P to V (all replications)
     void DisplayStats();                // Stats display
     float Mean(short i);                // Returns stats (mean value)
     float Dev(short i);                 // Returns stats (std dev)
+    int Id();                           // Returns resource id
+    virtual void Write(FILE *f);        // Writes state (checkpoint)
+    virtual int Read(FILE *f, Client **byid, int n); // Reads state (1: ok)
+    void WriteTotals(FILE *f);          // Writes stats of past replications
+    int ReadTotals(FILE *f);            // Reads stats of past replications
+    void Truncate();                    // Deletes replication stats so far
+    void Batch();                       // Closes a base batch (batch means)
+    void BatchMeans(int overlap);       // Stats from the base batches
 
   private:
 
     // Internal methods
 
-    void EnQueue(int eventcode, Client *client, int priority); // Insert
-    int GetEventCode();                 // Returns 1st event in queue
-    Client *GetClient();                // Returns 1st client in queue
-    void DestroyTop();                  // Deletes 1st element in queue
+    void P(int event, Client *client, int prior); // Reserves resource (any code)
+    void EnQueue(int eventcode, Client *client, int priority,
+                 SimTime date);         // Insert (date: enqueue date)
+    int DeQueue(QueueCell *cell);       // Removes 1st element in queue
     int QueueEmpty();                   // Queue status
+    void Levels();                      // Updates time-weighted levels
+    double Correlation(int k);          // Lag-1 autocorrelation of batch means
+    double OverlapHalfWidth(short i);   // Overlapping batch means conf. interval #i
+    void SaveBins(Histogram *h);        // Keeps a base batch's histogram
+    void BatchQuantiles(int b, int k, Histogram *h,
+                        double s[NSTATS]); // Quantiles of base batches b..b+k-1
 
     // Private attributes
 
     char name[STRS];                    // Resource name
-    QueueCell *top;                     // Queue top
-    QueueCell *bottom;                  // Queue bottom
+    int id;                             // Resource id
+    PriorityRing rings[PRIORITIES];     // Queue: one FIFO ring per priority
+    uint64_t levels;                    // Bitmap of non-empty rings
     int capacity;                       // Resource capacity
     int ccapacity;                      // Current capacity
     Simulation *simul;                  // Pointer toward simulation object
-    float response;                     // Response time (1 replication)
-    float wait;                         // Waiting time (1 replication)
+    double response;                    // Response time (1 replication)
+    double wait;                        // Waiting time (1 replication)
     int nbserv;                         // Number of clients served
-    float stats[5],stats2[5];           // Stats (accumulated)
-    int n;                              // Stats (number of experiences)
-    float mean[5], dev[5], cint[5];     // Mean values - Standard deviations - Confidence intervals
-                                        // 0 : Response time
+    Histogram waits, sojourns;          // Per-client times (1 replication)
+    Histogram allwaits, allsojourns;    // Per-client times (all replications)
+    TimeWeighted busy, waiting;         // Busy servers and queue length (1 replication)
+    Occupancy *occupancy;               // Tracked states (NULL: none)
+    int ncontrols;                      // Number of control variates
+    char ctrlname[MAX_CONTROLS][STRS];  // Control variates' names
+    double ctrlmean[MAX_CONTROLS];      // Known means
+    double ctrlsum[MAX_CONTROLS];       // Sums of observations (1 replication)
+    long ctrln[MAX_CONTROLS];           // Numbers of observations (1 replication)
+    Covariance cov[MAX_CONTROLS][NSTATS]; // Controls x stats co-moments (all replications)
+    double *batches;                    // Base batches stats (batch means)
+    long *binstart;                     // Base batches' 1st sojourn and wait bucket
+    int *binindex;                      // Base batches' histogram buckets
+    long *bincount;                     // Their counts
+    long nbins, bincap;                 // Number of buckets - Allocated
+    int nbatches, batchcap;             // Number of base batches - Allocated
+    int batchsize;                      // Base batches per batch (0: replications)
+    int batchoverlap;                   // 1: overlapping batch means
+    double batchr1;                     // Lag-1 autocorrelation of the batch means
+    Accumulator acc[NSTATS];            // Stats (accumulated over replications)
+    float mean[NSTATS], dev[NSTATS], cint[NSTATS]; // Mean values - Standard deviations - Confidence intervals
+                                        // 0 : Response time (service)
                                         // 1 : Waiting time
                                         // 2 : Number of clients served
                                         // 3 : Current number of clients
                                         // 4 : Number of waiting clients
+                                        // 5-8 : Sojourn time (P to V) p50, p90, p99, max
+                                        // 9-12 : Waiting time p50, p90, p99, max
+                                        // 13 : Utilization (time average)
+                                        // 14 : Number of clients L (time average)
+                                        // 15 : Queue length Lq (time average)
+                                        // 16.. : Fraction of time in tracked state 0..
+                                        // 32.. : Mean of control variate 0..
 
 };
 
 /////////////////////////////////////////////////////////////////////
-// CLASS QueueCell
+// CLASS Sweep
 /////////////////////////////////////////////////////////////////////
-// Resource queue cell
+// Parameter sweep: nreplic replications of each of npoints points of
+// a parameter grid, run as (point, replication) tasks on a pool of
+// threads. Each thread keeps one Simulation, set up by setup() when
+// it moves to another point. Tasks are dealt to the threads in
+// contiguous ranges, point by point; an idle thread steals the second
+// half of the largest remaining range. Replication r of every point
+// draws from substream r and results are merged in replication order,
+// so they depend neither on the number of threads nor on stealing.
+// Points are thus compared with common random numbers, if the model
+// takes each kind of draw from its own stream (see Simulation::Rng).
+// With antithetic pairs, replications 2j and 2j+1 share substream j,
+// the second one with draws 1-u; each pair gives one observation (the
+// average of both).
 /////////////////////////////////////////////////////////////////////
 
-class QueueCell {
+// Model set-up for a point (sim is a thread's private simulation)
+
+typedef void (*SweepSetup)(Simulation *sim, int point, void *data);
+
+// Leading (parameter) columns of a point's row, without end of line
+
+typedef void (*SweepLabel)(FILE *f, int point, void *data);
+
+// Output column: statistic #stat of resource #resource
+
+struct SweepOutput {
+  int resource;                         // Resource number
+  short stat;                           // Statistic number (0..NSTATS-1)
+  char label[STRS];                     // Column name
+};
+
+// Tasks [lo,hi) left to a thread
+
+struct SweepRange {
+  std::mutex lock;                      // Protects lo and hi
+  long lo, hi;                          // Task range
+};
+
+class Sweep {
 
   public:
 
     // Methods
 
-    QueueCell(int code, Client *cli, int prior); // Constructor
-    int Code();                         // Returns event code
-    Client *Cli();                      // Returns client
-    int Priority();                     // Returns priority
-    QueueCell *Next();                  // Returns next cell
-    QueueCell *Previous();              // Returns previous cell
-    void SetNext(QueueCell *newnext);   // New next cell
-    void SetPrevious(QueueCell *newprev); // New previous cell
+    Sweep(Simulation *sim, int npoints, SweepSetup setup,
+          void *data);                  // Constructor (sim: settings)
+    ~Sweep();                           // Destructor
+    int AddOutput(int res, short stat, const char *label); // New column (1: ok)
+    void Run(int nreplic, int nthreads,
+             int anti=0);               // Runs all tasks (anti: pairs)
+    double Mean(int point, int col);    // Returns mean of column col
+    double HalfWidth(int point, int col); // Returns conf. interval of col
+    double Difference(int point, int ref, int col,
+                      double *halfwidth); // Paired difference point-ref
+    long Steals();                      // Returns # of successful steals
+    void Write(FILE *f, const char *header, SweepLabel label); // CSV rows
+    void WriteDifferences(FILE *f, int ref, const char *header,
+                          SweepLabel label); // CSV rows (differences)
 
   private:
 
+    // Internal methods
+
+    void Worker(int w);                 // Thread body
+    int Next(int w, long *task);        // Own or stolen task (0: none left)
+    double Observation(int point, int j, int col); // Replication or pair j
+
     // Private attributes
 
-    int eventcode;                      // Event code
-    Client *client;                     // Client
-    int priority;                       // Priority
-    QueueCell *next;                    // Next cell
-    QueueCell *previous;                // Previous cell
+    Simulation *base;                   // Settings (times, seed, FEL, RNG)
+    int npoints;                        // Number of points
+    SweepSetup setup;                   // Point set-up
+    void *data;                         // Set-up data
+    SweepOutput outputs[MAX_OUTPUTS];   // Output columns
+    int noutputs;                       // Number of output columns
+    int nreplic;                        // Replications per point
+    int antithetic;                     // 1 if antithetic pairs
+    int nthreads;                       // Number of threads
+    SweepRange *ranges;                 // Tasks of each thread
+    std::atomic<long> nsteals;          // Successful steals
+    double *samples;                    // Outputs by task (nreplic*npoints)
+    Accumulator *acc;                   // Outputs by point (npoints*noutputs)
 
 };
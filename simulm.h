@@ -14,8 +14,13 @@
 /////////////////////////////////////////////////////////////////////
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <new>
+#include <atomic>
+#include <thread>
+#include <mutex>
 
 /////////////////////////////////////////////////////////////////////
 // CLASS Simulation
@@ -23,58 +28,118 @@
 
 // CLASS Simulation: Constructor
 
-Simulation::Simulation(float start, float max, long int seed) {
+Simulation::Simulation(SimTime start, SimTime max, long int seed, int fel, int gen) {
 
+  int k;
+
+  rng=NewRandomStream(gen,DEFAULT_SEED);
+  for (k=0; k<MAX_STREAMS; k++) {
+    streams[k]=NULL;
+    mirrors[k]=NULL;
+    current[k]=NULL;
+    variates[k]=NULL;
+  }
+  streams[0]=rng;
+  current[0]=rng;
+  cursub=-1;
+  antithetic=0;
   Reset(start, max, seed);
+  felkind=fel;
+  genkind=gen;
+  dispatch=DISPATCH_TABLE;
+  nevents=0;
+  nclients=0;
+  nresources=0;
+  registrycapacity=16;
+  registry=new Resource*[registrycapacity];
+  replic=0;
+  trace=NULL;
+  ntargets=0;
   clientlist=NULL;
-  scheduler=new Scheduler;
+  handlecapacity=16;
+  handles=new Client*[handlecapacity];
+  freehandles=new int[handlecapacity];
+  handles[0]=NULL;
+  nhandles=1;
+  nfree=0;
+  arena=new Arena;
+  scheduler=new Scheduler(arena, fel);
   eventmanager=new EventManager(this);
+  ckptfile=NULL;
+  ckptwall=0;
+  ckptsim=0;
+  ckptnext=0;
+  warmup=0;
+  twarm=TIME_NEVER;
+  snapshot=NULL;
+  batchlength=0;
+  batchclients=0;
+  batchnext=0;
+  batchcount=0;
 }
 
 // CLASS Simulation: Destructor
 
 Simulation::~Simulation() {
 
+  int k;
+
   delete scheduler;
   delete eventmanager;
+  delete[] registry;
+  delete[] handles;
+  delete[] freehandles;
+  delete arena;
+  for (k=0; k<MAX_STREAMS; k++) {
+    delete streams[k];                  // streams[0] is rng
+    delete mirrors[k];
+    delete variates[k];
+  }
 }
 
 // CLASS Simulation: Simulation execution
 
 void Simulation::Run(int nreplic) {
 
-  int i, nextevent, charcount;
-  Client *client;
-
   // Initialization
   eventmanager->Init();
 
-  printf("\nSimulation started... ");
-  charcount=21;
+  LogInfo("\nSimulation started... ");
+  Replications(1,nreplic,21,0);
+}
+
+// CLASS Simulation: Run() from a checkpoint: the replication in
+// progress is completed, then replications go on up to nreplic
+// Returns 1 if successful, 0 if the checkpoint cannot be restored
+
+int Simulation::Resume(const char *filename, int nreplic) {
+
+  if (!Restore(filename)) return 0;
+
+  LogInfo("\nSimulation resumed... ");
+  Replications(replic,nreplic,23,1);
+  return 1;
+}
+
+// CLASS Simulation: Replications first..nreplic (resumed: replication
+// first is already under way), then results
+
+void Simulation::Replications(int first, int nreplic, int charcount, int resumed) {
+
+  int i;
 
-  for (i=1; i<=nreplic; i++) {
+  for (i=first; i<=nreplic; i++) {
 
     charcount+=(digit(i)+3);
     if (charcount>79) {
       charcount=digit(i)+3;
-      printf("\n");
-    }
-    printf("[%d] ",i);
-    // Replication initialization
-    tnow=tstart;
-	
-    eventmanager->InitRep();
-	client=NewClient();      // DO NOT FORGET TO DESTROY CLIENTS!
-	eventmanager->ExecuteEvent(0,client);
-    
-	// Engine
-    while ((tnow<tmax) && (!scheduler->IsEmpty())) {      
-	  nextevent=scheduler->GetEventCode();
-      tnow=scheduler->GetEventDate();
-      client=scheduler->GetClient();
-      scheduler->DestroyEvent();
-      eventmanager->ExecuteEvent(nextevent,client);
+      LogInfo("\n");
     }
+    LogInfo("[%d] ",i);
+    replic=i;
+    if (resumed && (i==first)) Engine();
+    else if (snapshot!=NULL) Fork(i);
+    else Replicate();
 
     // Statistics computation
     eventmanager->Stats();
@@ -84,11 +149,412 @@ void Simulation::Run(int nreplic) {
   }
 
   charcount+=17;
-  if (charcount>79) printf("\n");
-  printf("End of simulation\n");
+  if (charcount>79) LogInfo("\n");
+  LogInfo("End of simulation\n");
+
+  // Results
+  eventmanager->DisplayStats();
+}
+
+// CLASS Simulation: Multi-threaded simulation execution
+// Replication i always draws from substream i of the simulation seed
+// and statistics are merged in replication order, so results do not
+// depend on the number of threads.
+
+void Simulation::RunParallel(int nreplic, int nthreads) {
+
+  int charcount;
+
+  if (nthreads<1) nthreads=1;
+
+  // Initialization
+  eventmanager->Init();
+
+  LogInfo("\nSimulation started (%d threads)... ",nthreads);
+  charcount=33+digit(nthreads);
+
+  RunBatch(0,nreplic,nthreads,&charcount);
+
+  charcount+=17;
+  if (charcount>79) LogInfo("\n");
+  LogInfo("End of simulation\n");
+
+  // Results
+  eventmanager->DisplayStats();
+}
+
+// CLASS Simulation: New stopping target for RunSequential(): the
+// confidence interval half-width of statistic #stat of resource #res
+// must not exceed halfwidth (times |mean| if relative is not 0)
+// Returns 1 if successful, 0 if there are too many targets
+
+int Simulation::AddTarget(int res, short stat, double halfwidth, int relative) {
+
+  if (ntargets>=MAX_TARGETS) return 0;
+  targets[ntargets].resource=res;
+  targets[ntargets].stat=stat;
+  targets[ntargets].halfwidth=halfwidth;
+  targets[ntargets].relative=relative;
+  ntargets++;
+  return 1;
+}
+
+// CLASS Simulation: Sequential simulation execution
+// Replications are run by batches of batch replications (default:
+// SEQ_MIN) on nthreads threads, as in RunParallel, until every target
+// is met or maxreplic replications have been run. Targets are checked
+// between batches only, so the result depends on batch but not on
+// nthreads.
+// Returns the number of replications run.
+
+int Simulation::RunSequential(int maxreplic, int nthreads, int batch) {
+
+  int done, count, met, i, charcount;
+  Resource *res;
+  double hw;
+
+  if (nthreads<1) nthreads=1;
+  if (batch<1) batch=SEQ_MIN;
+
+  // Initialization
+  eventmanager->Init();
+
+  LogInfo("\nSimulation started (sequential, %d threads)... ",nthreads);
+  charcount=45+digit(nthreads);
+
+  done=0;
+  met=0;
+  while ((done<maxreplic) && (!met)) {
+    count=batch;
+    if (done+count<SEQ_MIN) count=SEQ_MIN-done;
+    if (done+count>maxreplic) count=maxreplic-done;
+    RunBatch(done,count,nthreads,&charcount);
+    done+=count;
+    met=TargetsMet();
+  }
+
+  charcount+=17;
+  if (charcount>79) LogInfo("\n");
+  LogInfo("End of simulation\n");
+
+  // Results
+  eventmanager->DisplayStats();
+
+  printf("\n*** SEQUENTIAL STOPPING\n\n");
+  printf("\t* Replications run                : %10d\t(%s)\n",done,
+         met ? "all targets met" : "maximum reached");
+  for (i=0; i<ntargets; i++) {
+    res=GetResource(targets[i].resource);
+    if (res==NULL) continue;
+    hw=targets[i].halfwidth;
+    if (targets[i].relative) hw*=fabs(res->Acc(targets[i].stat)->Mean());
+    printf("\t* Resource #%d, statistic #%-2d      : %10.4f\t(target %10.4f)\n",
+           targets[i].resource,targets[i].stat,res->HalfWidth(targets[i].stat),hw);
+  }
+
+  return done;
+}
+
+// CLASS Simulation: Returns 1 if every stopping target is met
+
+int Simulation::TargetsMet() {
+
+  Resource *res;
+  double hw;
+  int i;
+
+  for (i=0; i<ntargets; i++) {
+    res=GetResource(targets[i].resource);
+    if ((res==NULL) || (res->Acc(targets[i].stat)==NULL)) continue;
+    if (res->Acc(targets[i].stat)->Count()<2) return 0;
+    hw=targets[i].halfwidth;
+    if (targets[i].relative) hw*=fabs(res->Acc(targets[i].stat)->Mean());
+    if (res->HalfWidth(targets[i].stat)>hw) return 0;
+  }
+  return 1;
+}
+
+// CLASS Simulation: Runs replications first..first+count-1 on
+// nthreads threads and accumulates their statistics (replication
+// order); *charcount is the progress display column
+
+void Simulation::RunBatch(int first, int count, int nthreads, int *charcount) {
+
+  std::thread **threads;
+  std::atomic<int> next(first);
+  std::mutex lock;
+  double *samples, *s;
+  int nres, i, r;
+
+  nres=NbResources();
+  samples=new double[count*nres*NSTATS];
+
+  threads=new std::thread*[nthreads];
+  for (i=0; i<nthreads; i++)
+    threads[i]=new std::thread(&Simulation::Worker,this,first,first+count,&next,
+                               samples,&lock);
+  for (i=0; i<nthreads; i++) {
+    threads[i]->join();
+    delete threads[i];
+  }
+  delete[] threads;
+
+  // Statistics merging (replication order)
+  for (i=first+1; i<=first+count; i++) {
+    *charcount+=(digit(i)+3);
+    if (*charcount>79) {
+      *charcount=digit(i)+3;
+      LogInfo("\n");
+    }
+    LogInfo("[%d] ",i);
+    for (r=0; r<nres; r++) {
+      s=samples+((i-first-1)*nres+r)*NSTATS;
+      if (GetResource(r)!=NULL) GetResource(r)->Accumulate(s);
+    }
+  }
+  delete[] samples;
+}
+
+// CLASS Simulation: Worker thread body
+// Runs replications first..last-1 taken from a shared counter on a
+// private copy of the simulation (scheduler, event manager, resources,
+// RNG stream). Histograms are merged into the master's resources at
+// the end (counters are added, so the order of the threads does not
+// matter).
+
+void Simulation::Worker(int first, int last, std::atomic<int> *next,
+                        double *samples, std::mutex *lock) {
+
+  Simulation *sim;
+  int nres, i, r;
+
+  sim=new Simulation(tstart,tmax,rseed,felkind,genkind);
+  sim->SetWarmup(warmup);
+  sim->SetDispatch(dispatch);
+  nres=sim->NbResources();
+
+  while ((i=(*next)++)<last) {
+    sim->Substream(i,0);
+    sim->Replicate();
+    for (r=0; r<nres; r++) {
+      if (sim->GetResource(r)==NULL) continue;
+      sim->GetResource(r)->Sample(samples+((i-first)*nres+r)*NSTATS);
+      sim->GetResource(r)->Collect();
+    }
+    sim->PurgeClientList();
+  }
+
+  lock->lock();
+  for (r=0; r<nres; r++)
+    if (GetResource(r)!=NULL)
+      GetResource(r)->MergeHistograms(sim->GetResource(r));
+  lock->unlock();
+
+  delete sim;
+}
+
+// CLASS Simulation: Runs one replication (statistics are left in
+// resources); event #0 is executed on resource #0
+
+void Simulation::Replicate() {
+
+  Client *client;
+
+  // Replication initialization
+  tnow=tstart;
+  nclients=0;
+  ckptnext=tstart+ckptsim;
+  if ((warmup>0) || (batchcount<0)) twarm=tstart+warmup;
+  else twarm=TIME_NEVER;
+
+  eventmanager->InitRep();
+  arena->Release();        // Scheduler, queues and clients are empty
+  client=NewClient();      // DO NOT FORGET TO DESTROY CLIENTS!
+  if (trace!=NULL) trace->Write(Units(tnow),0,client->id,0,replic);
+  EventHandler<0>::Execute(client,GetResource(0));
+
+  Engine();
+}
+
+// CLASS Simulation: Event loop (up to tmax or until no event is left)
+// Periodic checkpoints are taken between two events. The loop is
+// compiled once per dispatch mode, so the mode costs no test per event.
+
+template <int mode> void Simulation::Loop() {
+
+  EventRecord ev;
+  Client *client;
+
+  while ((tnow<tmax) && scheduler->PopNext(&ev)) {
+    if (ev.date>=twarm) Truncate();     // End of warm-up period
+    tnow=ev.date;
+    client=handles[ev.client];
+    if (trace!=NULL)
+      trace->Write(Units(tnow),ev.code,(client!=NULL)?client->id:-1,ev.resource,replic);
+    if (mode==DISPATCH_SWITCH)
+      eventmanager->SwitchEvent(ev.code,client,GetResource(ev.resource));
+    else eventmanager->ExecuteEvent(ev.code,client,GetResource(ev.resource));
+    nevents++;
+    if ((ckptfile!=NULL) && CheckpointDue()) Checkpoint(ckptfile);
+  }
+}
+
+// CLASS Simulation: Event loop with the dispatch mode in use
+
+void Simulation::Engine() {
+
+  if (dispatch==DISPATCH_SWITCH) Loop<DISPATCH_SWITCH>();
+  else Loop<DISPATCH_TABLE>();
+}
+
+// CLASS Simulation: Warm-up period: the statistics of each replication
+// gathered before tstart+length are deleted (0: none)
+
+void Simulation::SetWarmup(SimTime length) {
+
+  if (length>0) warmup=length;
+  else warmup=0;
+}
+
+// CLASS Simulation: Deletes the statistics gathered so far in the
+// replication, at the end of the warm-up period (the system state is
+// kept). In a batch means run, also closes the current base batch and
+// sets the end of the next one.
+
+void Simulation::Truncate() {
+
+  int i;
+
+  tnow=twarm;
+  for (i=0; i<nresources; i++)
+    if (registry[i]!=NULL) {
+      if (batchcount>=0) registry[i]->Batch();
+      registry[i]->Truncate();
+    }
+  twarm=TIME_NEVER;
+  if ((batchlength>0) || (batchclients>0)) {
+    batchcount++;
+    if (batchclients>0) batchnext=nclients+batchclients;
+    else if (batchcount<BATCH_BASE-1)
+      twarm=tstart+warmup+(batchcount+1)*batchlength;
+    else if (batchcount==BATCH_BASE-1) twarm=tmax;
+  }
+}
+
+// CLASS Simulation: Batch means: one long run from tstart to tmax,
+// the warm-up period (see SetWarmup) being deleted once. The rest is
+// split into BATCH_BASE base batches of equal simulated time, or
+// into base batches of clients created (clients>0). Each resource
+// then groups consecutive base batches into batches, doubling their
+// size until the lag-1 autocorrelation of the batch means is no
+// longer significant (keeping at least BATCH_MIN batches), and its
+// statistics are computed over the batch means as over replications
+// (overlap=1: overlapping batch means confidence intervals).
+// Periodic checkpoints are not taken.
+
+void Simulation::RunBatchMeans(int clients, int overlap) {
+
+  const char *ckpt;
+  int i;
+
+  // Initialization
+  eventmanager->Init();
+  ckpt=ckptfile;
+  ckptfile=NULL;
+  batchclients=(clients>0) ? clients : 0;
+  if (batchclients>0) batchlength=0;
+  else batchlength=(tmax-tstart-warmup)/BATCH_BASE;
+  if ((batchclients==0) && (batchlength<=0)) {
+    LogError("Error: no simulated time left after the warm-up\n");
+    ckptfile=ckpt;
+    return;
+  }
+  batchcount=-1;
+  batchnext=0;
+
+  LogInfo("\nSimulation started... ");
+  replic=1;
+  Replicate();
+  PurgeClientList();
+  LogInfo("%d base batches, end of simulation\n",batchcount);
 
   // Results
+  for (i=0; i<nresources; i++)
+    if (registry[i]!=NULL) registry[i]->BatchMeans(overlap);
   eventmanager->DisplayStats();
+
+  batchlength=0;
+  batchclients=0;
+  batchnext=0;
+  batchcount=0;
+  ckptfile=ckpt;
+}
+
+// CLASS Simulation: Warm start: the warm-up period (see SetWarmup) is
+// simulated once, from tstart on substream 0; its final state is kept
+// in a snapshot, from which each replication i starts again with
+// substream i (instead of repeating the warm-up)
+
+void Simulation::RunWarmStart(int nreplic) {
+
+  const char *ckpt;
+  SimTime end;
+
+  // Initialization
+  eventmanager->Init();
+  snapshot=tmpfile();
+  if (snapshot==NULL) {
+    LogError("Error: cannot create the warm-up snapshot\n");
+    return;
+  }
+  ckpt=ckptfile;           // No periodic checkpoint (Run() only)
+  ckptfile=NULL;
+
+  // Warm-up (not counted in statistics), then snapshot
+  LogInfo("\nWarm-up... ");
+  end=tmax;
+  tmax=tstart+warmup;
+  replic=0;
+  Substream(0,0);
+  Replicate();
+  tmax=end;
+  Save(snapshot,0);
+  LogInfo("done at time %f (%ld events)",(double)Units(tnow),nevents);
+
+  LogInfo("\nSimulation started... ");
+  Replications(1,nreplic,21,0);
+
+  fclose(snapshot);
+  snapshot=NULL;
+  ckptfile=ckpt;
+}
+
+// CLASS Simulation: Replication #i of a warm start: the warm-up
+// snapshot is restored and statistics restart at its date
+
+void Simulation::Fork(int i) {
+
+  SimTime end;
+  long n;
+
+  end=tmax;
+  n=nevents;
+  rewind(snapshot);
+  if (!Load(snapshot,"warm-up snapshot",0)) return;
+  tmax=end;
+  nevents=n;
+  replic=i;
+  Substream(i,0);
+  twarm=tnow;
+  Truncate();
+  Engine();
+}
+
+// CLASS Simulation: Returns the number of events executed
+
+long Simulation::Events() {
+
+  return nevents;
 }
 
 // CLASS Simulation: Returns the Scheduler address
@@ -100,29 +566,37 @@ Scheduler *Simulation::Sched() {
 
 // CLASS Simulation: Returns tnow
 
-float Simulation::Tnow() {
+SimTime Simulation::Tnow() {
 
   return tnow;
 }
 
 // CLASS Simulation: Returns tmax
 
-float Simulation::Tmax() {
+SimTime Simulation::Tmax() {
 
   return tmax;
 }
 
 // CLASS Simulation: Reinitialization
 
-void Simulation::Reset(float start, float max, long int seed) {
+void Simulation::Reset(SimTime start, SimTime max, long int seed) {
+
+  int k;
 
   tstart=start;
   tmax=max;
   if (seed>0) rseed=seed;
   else rseed=DEFAULT_SEED;
 
-  // Randomize
-  lp_tt=rseed;
+  // Randomize (stream k>0 from a hash of the seed and k)
+  rng->Seed(rseed);
+  for (k=1; k<MAX_STREAMS; k++)
+    if (streams[k]!=NULL) streams[k]->Seed(StreamSeed(rseed,k));
+  for (k=0; k<MAX_STREAMS; k++) current[k]=streams[k];
+  cursub=-1;
+  antithetic=0;
+  Rebind();
 }
 
 // CLASS Simulation: Creation of a new client in clientlist
@@ -131,7 +605,10 @@ Client *Simulation::NewClient() {
 
   Client *newclient;
 
-  newclient=new Client;
+  newclient=new (arena->Alloc(ARENA_CLIENT,sizeof(Client))) Client;
+  newclient->id=++nclients;
+  Attach(newclient);
+  if (nclients==batchnext) twarm=tnow;  // End of base batch (batch means)
   // Insertion on top
   newclient->next=clientlist;
   newclient->previous=NULL;
@@ -153,198 +630,1577 @@ void Simulation::KillClient(Client *client) {
   else clientlist=n; // on top
   if (n!=NULL) n->previous=p;
 
-  delete client;
+  handles[client->handle]=NULL;
+  freehandles[nfree++]=client->handle;
+  arena->Free(ARENA_CLIENT,client);
 }
 
 // CLASS Simulation: Deletion of all clients in clientlist
+// (memory is given back by the next arena release)
 
 void Simulation::PurgeClientList() {
 
-  Client *cour, *prec;
+  clientlist=NULL;
+  nhandles=1;
+  nfree=0;
+}
 
-  cour=clientlist;
-  prec=NULL;
-  while (cour!=NULL) {
-    prec=cour;
-    cour=cour->next;
-    delete prec;
+// CLASS Simulation: Gives client a handle, its index in handles
+// (events refer to clients by handle, see EventRecord). Handles of
+// killed clients are reused, so the table stays as large as the
+// largest population; it doubles when full.
+
+void Simulation::Attach(Client *client) {
+
+  Client **larger;
+  int i;
+
+  if (nfree>0) client->handle=freehandles[--nfree];
+  else {
+    if (nhandles==handlecapacity) {
+      larger=new Client*[2*handlecapacity];
+      for (i=0; i<nhandles; i++) larger[i]=handles[i];
+      delete[] handles;
+      delete[] freehandles;
+      handles=larger;
+      handlecapacity*=2;
+      freehandles=new int[handlecapacity];
+    }
+    client->handle=nhandles++;
   }
-  clientlist=NULL;
+  handles[client->handle]=client;
 }
 
-/////////////////////////////////////////////////////////////////////
-// CLASS Scheduler
-/////////////////////////////////////////////////////////////////////
+// CLASS Simulation: Returns the replication arena
 
-// CLASS Scheduler: Constructor
+Arena *Simulation::Mem() {
+
+  return arena;
+}
 
-Scheduler::Scheduler() {
+// CLASS Simulation: Registers a resource; returns its id (0, 1, ...,
+// -1 past MAX_RESOURCES). The registry doubles when full, so
+// GetResource() is O(1).
 
-  top=NULL;
-  bottom=NULL;
+int Simulation::Register(Resource *res) {
+
+  Resource **larger;
+  int i;
+
+  if (nresources==MAX_RESOURCES) {
+    LogError("Error: more than %d resources\n",MAX_RESOURCES);
+    return -1;
+  }
+  if (nresources==registrycapacity) {
+    larger=new Resource*[2*registrycapacity];
+    for (i=0; i<nresources; i++) larger[i]=registry[i];
+    delete[] registry;
+    registry=larger;
+    registrycapacity*=2;
+  }
+  registry[nresources]=res;
+  return nresources++;
 }
 
-// CLASS Scheduler: Destructor
+// CLASS Simulation: Removes a resource from the registry (its id is
+// not reused)
 
-Scheduler::~Scheduler() {
+void Simulation::Unregister(int id) {
 
-  Purge();
+  if ((id>=0) && (id<nresources)) registry[id]=NULL;
 }
 
-// CLASS Scheduler: Returns scheduler state
-// (1 if empty, 0 if not)
+// CLASS Simulation: Returns the number of resource ids given
 
-int Scheduler::IsEmpty() {
+int Simulation::NbResources() {
 
-  if (top==NULL) return 1;
-  else return 0;
+  return nresources;
 }
 
-// CLASS Scheduler: Insertion into scheduler
+// CLASS Simulation: Returns resource #id (NULL if none)
 
-void Scheduler::Schedule(int eventcode, float eventdate, Client *client) {
+Resource *Simulation::GetResource(int id) {
 
-  SchedulerCell *prec, *cour, *nouv;
+  if ((id>=0) && (id<nresources)) return registry[id];
+  else return NULL;
+}
 
-  nouv=new SchedulerCell(eventcode,eventdate,client);
+// CLASS Simulation: Sets the binary trace sink (NULL: no trace)
+// Only Run() traces; RunParallel() workers do not.
 
-  prec=NULL;
-  cour=bottom;
+void Simulation::SetTrace(TraceWriter *tw) {
 
-  while ((cour!=NULL) && (eventdate<cour->Date())) {
-    prec=cour;
-    cour=cour->Previous();
+  trace=tw;
+}
+
+// CLASS Simulation: Sets the event dispatch of the model's events
+// (DISPATCH_TABLE: handler table, DISPATCH_SWITCH: switch); both give
+// the same results
+
+void Simulation::SetDispatch(int mode) {
+
+  if (mode==DISPATCH_SWITCH) dispatch=DISPATCH_SWITCH;
+  else dispatch=DISPATCH_TABLE;
+}
+
+// CLASS Simulation: Returns the random generator
+
+RandomStream *Simulation::Rng() {
+
+  return current[0];
+}
+
+// CLASS Simulation: Returns random stream #k (0..MAX_STREAMS-1; others
+// give stream 0). Streams are independent (seeded from a hash of the
+// seed and k) and all move to the same substream at each replication
+// of RunParallel(), RunWarmStart() or a Sweep: a model that takes each
+// kind of draw (arrivals, services...) from its own stream gets the
+// same draws in two scenarios (common random numbers).
+
+RandomStream *Simulation::Rng(int k) {
+
+  if ((k<0) || (k>=MAX_STREAMS)) k=0;
+  if (streams[k]==NULL) {
+    streams[k]=NewRandomStream(genkind,StreamSeed(rseed,k));
+    if (cursub>=0) streams[k]->Substream(cursub);
+    if (antithetic) {
+      mirrors[k]=new Antithetic(streams[k]);
+      current[k]=mirrors[k];
+    } else current[k]=streams[k];
   }
+  return current[k];
+}
 
-  nouv->SetPrevious(cour);
-  nouv->SetNext(prec);
+// CLASS Simulation: Moves all streams to substream i; their draws are
+// antithetic (1-u) if anti is not 0
 
-  if (prec!=NULL) prec->SetPrevious(nouv);
-  else bottom=nouv;
-  if (cour!=NULL) cour->SetNext(nouv);
-  else top=nouv;
+void Simulation::Substream(long i, int anti) {
+
+  int k;
+
+  cursub=i;
+  antithetic=anti;
+  for (k=0; k<MAX_STREAMS; k++) {
+    if (streams[k]==NULL) continue;
+    streams[k]->Substream(i);
+    if (anti) {
+      if (mirrors[k]==NULL) mirrors[k]=new Antithetic(streams[k]);
+      current[k]=mirrors[k];
+    } else current[k]=streams[k];
+  }
+  Rebind();
 }
 
-// CLASS Scheduler: Returns 1st event code
+// CLASS Simulation: Returns the buffered variates of random stream #k
+// (see Rng(k) and simvar.h). A stream drawn through its variates must
+// not be drawn directly as well.
 
-int Scheduler::GetEventCode() {
+VariateStream *Simulation::Variates(int k) {
 
-  if (top!=NULL) return top->Code();
-  else return -1;
+  if ((k<0) || (k>=MAX_STREAMS)) k=0;
+  if (variates[k]==NULL) variates[k]=new VariateStream(Rng(k));
+  return variates[k];
 }
 
-// CLASS Scheduler: Returns last event code
+// CLASS Simulation: Points the buffered variates at the current
+// streams, dropping their buffers (after a reseed or a substream
+// change)
 
-float Scheduler::GetEventDate() {
+void Simulation::Rebind() {
 
-  if (top!=NULL) return top->Date();
-  else return -1;
+  int k;
+
+  for (k=0; k<MAX_STREAMS; k++)
+    if (variates[k]!=NULL) variates[k]->SetStream(current[k]);
 }
 
-// CLASS Scheduler: Returns pointer toward client
+// CLASS Simulation: Returns the event manager (e.g. to set the model
+// up between runs)
 
-Client *Scheduler::GetClient() {
+EventManager *Simulation::Manager() {
 
-  if (top!=NULL) return top->Cli();
-  else return NULL;
+  return eventmanager;
 }
 
-// CLASS Scheduler: Deletes 1st event
+// CLASS Simulation: Writes the complete engine state to filename
+// (through filename.tmp, renamed once complete, so that a crash while
+// writing leaves the previous checkpoint intact). Must be called
+// between two events, e.g. from an event handler or by Run() itself
+// (see SetCheckpoint). Returns 1 if successful, 0 otherwise.
 
-void Scheduler::DestroyEvent() {
+int Simulation::Checkpoint(const char *filename) {
 
-  SchedulerCell *sauve;
+  char tmpname[FILENAME_MAX];
+  FILE *f;
+  int ok;
 
-  sauve=top;
-  if (top->Next()!=NULL) {
-    top=top->Next();
-    top->SetPrevious(NULL);
-  } else {
-    top=NULL;
-    bottom=NULL;
+  snprintf(tmpname,sizeof(tmpname),"%s.tmp",filename);
+  f=fopen(tmpname,"wb");
+  if (f==NULL) {
+    LogError("Error: cannot open checkpoint file %s\n",tmpname);
+    return 0;
+  }
+
+  ok=Save(f,1);
+  if (fclose(f)!=0) ok=0;
+  if (ok && (rename(tmpname,filename)!=0)) ok=0;
+  if (!ok) {
+    LogError("Error: cannot write checkpoint file %s\n",filename);
+    remove(tmpname);
+    return 0;
   }
-  delete sauve;
+  ckptlast=std::chrono::steady_clock::now();
+  return 1;
 }
 
-// CLASS Scheduler: Empties the scheduler
+// CLASS Simulation: Reads a state written by Checkpoint(). The
+// simulation must have been built by the same program (same model
+// and random generator). Returns 1 if successful, 0 otherwise (the
+// simulation must then not be run).
 
-void Scheduler::Purge() {
+int Simulation::Restore(const char *filename) {
 
-  SchedulerCell *cour, *save;
+  FILE *f;
+  int ok;
 
-  cour=bottom;
-  while (cour!=NULL) {
-    save=cour;
-    cour=cour->Next();
-    delete save;
+  f=fopen(filename,"rb");
+  if (f==NULL) {
+    LogError("Error: cannot open checkpoint file %s\n",filename);
+    return 0;
   }
+  ok=Load(f,filename,1);
+  fclose(f);
+  if (!ok) return 0;
 
-  top=NULL;
-  bottom=NULL;
+  ckptnext=tnow+ckptsim;
+  ckptlast=std::chrono::steady_clock::now();
+  return 1;
+}
+
+// CLASS Simulation: Writes the engine state to f (see CheckpointHeader),
+// with the statistics of past replications if totals is not 0
+// Returns 1 if successful, 0 otherwise.
+
+int Simulation::Save(FILE *f, int totals) {
+
+  CheckpointHeader h;
+  Client *c;
+  int n, i, present;
+
+  h.magic=CKPT_MAGIC;
+  h.version=CKPT_VERSION;
+  h.clientsize=sizeof(Client);
+  h.nstats=NSTATS;
+  h.priorities=PRIORITIES;
+  h.nresources=nresources;
+  h.genkind=genkind;
+  h.totals=totals;
+  h.timekind=TIME_KIND;
+  h.ticks=SIM_TIME_TICKS;
+  fwrite(&h,sizeof(h),1,f);
+
+  // Engine
+  fwrite(&tstart,sizeof(tstart),1,f);
+  fwrite(&tmax,sizeof(tmax),1,f);
+  fwrite(&tnow,sizeof(tnow),1,f);
+  fwrite(&twarm,sizeof(twarm),1,f);
+  fwrite(&rseed,sizeof(rseed),1,f);
+  fwrite(&nevents,sizeof(nevents),1,f);
+  fwrite(&nclients,sizeof(nclients),1,f);
+  fwrite(&replic,sizeof(replic),1,f);
+  fwrite(&cursub,sizeof(cursub),1,f);
+  fwrite(&antithetic,sizeof(antithetic),1,f);
+  for (i=0; i<MAX_STREAMS; i++) {
+    present=(streams[i]!=NULL);
+    fwrite(&present,sizeof(present),1,f);
+    if (present) streams[i]->Write(f);
+    present=(variates[i]!=NULL);
+    fwrite(&present,sizeof(present),1,f);
+    if (present) variates[i]->Write(f);
+  }
+
+  // Clients (list order; links are rebuilt by Load)
+  n=0;
+  for (c=clientlist; c!=NULL; c=c->next) n++;
+  fwrite(&n,sizeof(n),1,f);
+  for (c=clientlist; c!=NULL; c=c->next) fwrite(c,sizeof(Client),1,f);
+
+  // Future events and resources
+  scheduler->Write(f,handles);
+  for (i=0; i<nresources; i++) {
+    present=(registry[i]!=NULL);
+    fwrite(&present,sizeof(present),1,f);
+    if (present) {
+      registry[i]->Write(f);
+      if (totals) registry[i]->WriteTotals(f);
+    }
+  }
+
+  return (ferror(f)==0);
+}
+
+// CLASS Simulation: Reads the engine state written by Save() with the
+// same totals flag (name: source, for messages). Returns 1 if
+// successful, 0 otherwise.
+
+int Simulation::Load(FILE *f, const char *name, int totals) {
+
+  CheckpointHeader h;
+  Client **byid, *c, *last;
+  int n, i, present, ok;
+
+  if ((fread(&h,sizeof(h),1,f)!=1) || (h.magic!=CKPT_MAGIC)) {
+    LogError("Error: %s is not a checkpoint file\n",name);
+    return 0;
+  }
+  if ((h.version!=CKPT_VERSION) || (h.clientsize!=sizeof(Client)) ||
+      (h.nstats!=NSTATS) || (h.priorities!=PRIORITIES) ||
+      (h.nresources!=nresources) || (h.genkind!=genkind) ||
+      (h.totals!=(uint32_t)totals) || (h.timekind!=TIME_KIND) ||
+      (h.ticks!=SIM_TIME_TICKS)) {
+    LogError("Error: checkpoint %s (version %u) does not match this simulation\n",
+             name,h.version);
+    return 0;
+  }
+
+  // Engine
+  ok=1;
+  ok&=(fread(&tstart,sizeof(tstart),1,f)==1);
+  ok&=(fread(&tmax,sizeof(tmax),1,f)==1);
+  ok&=(fread(&tnow,sizeof(tnow),1,f)==1);
+  ok&=(fread(&twarm,sizeof(twarm),1,f)==1);
+  ok&=(fread(&rseed,sizeof(rseed),1,f)==1);
+  ok&=(fread(&nevents,sizeof(nevents),1,f)==1);
+  ok&=(fread(&nclients,sizeof(nclients),1,f)==1);
+  ok&=(fread(&replic,sizeof(replic),1,f)==1);
+  ok&=(fread(&cursub,sizeof(cursub),1,f)==1);
+  ok&=(fread(&antithetic,sizeof(antithetic),1,f)==1);
+  for (i=0; ok && (i<MAX_STREAMS); i++) {
+    ok&=(fread(&present,sizeof(present),1,f)==1);
+    if (ok && present) {
+      if (streams[i]==NULL) streams[i]=NewRandomStream(genkind,StreamSeed(rseed,i));
+      ok&=streams[i]->Read(f);
+    }
+    if (antithetic && (streams[i]!=NULL)) {
+      if (mirrors[i]==NULL) mirrors[i]=new Antithetic(streams[i]);
+      current[i]=mirrors[i];
+    } else current[i]=streams[i];
+    ok&=(fread(&present,sizeof(present),1,f)==1);
+    if (ok && present && (current[i]==NULL)) ok=0;
+    if (ok && present) {
+      if (variates[i]==NULL) variates[i]=new VariateStream(current[i]);
+      else variates[i]->SetStream(current[i]);
+      ok&=variates[i]->Read(f);
+    } else if (variates[i]!=NULL) variates[i]->SetStream(current[i]);
+  }
+  if (!ok || (nclients<0)) {
+    LogError("Error: checkpoint file %s is truncated or damaged\n",name);
+    return 0;
+  }
+
+  // Clients, rebuilt in the arena (byid: clients by id, for events
+  // and queues)
+  scheduler->Purge();
+  arena->Release();
+  PurgeClientList();
+  byid=new Client*[nclients+1];
+  for (i=0; i<=nclients; i++) byid[i]=NULL;
+  ok&=(fread(&n,sizeof(n),1,f)==1);
+  last=NULL;
+  for (i=0; ok && (i<n); i++) {
+    c=new (arena->Alloc(ARENA_CLIENT,sizeof(Client))) Client;
+    ok&=(fread(c,sizeof(Client),1,f)==1);
+    if (ok && ((c->id<1) || (c->id>nclients))) ok=0;
+    if (!ok) break;
+    c->next=NULL;
+    c->previous=last;
+    if (last!=NULL) last->next=c;
+    else clientlist=c;
+    last=c;
+    byid[c->id]=c;
+    Attach(c);
+  }
+
+  // Future events and resources
+  if (ok) ok&=scheduler->Read(f,byid,nclients);
+  for (i=0; ok && (i<nresources); i++) {
+    ok&=(fread(&present,sizeof(present),1,f)==1);
+    if (ok && (present!=(registry[i]!=NULL))) ok=0;
+    if (ok && present) {
+      ok&=registry[i]->Read(f,byid,nclients);
+      if (ok && totals) ok&=registry[i]->ReadTotals(f);
+    }
+  }
+
+  delete[] byid;
+  if (!ok) {
+    LogError("Error: checkpoint file %s is truncated or damaged\n",name);
+    return 0;
+  }
+  return 1;
+}
+
+// CLASS Simulation: Periodic checkpoints of Run() to filename, every
+// wallperiod seconds of wall time and/or every simperiod units of
+// simulated time (0: not used). Checkpoints are always taken between
+// two events; filename=NULL stops them.
+
+void Simulation::SetCheckpoint(const char *filename, double wallperiod, SimTime simperiod) {
+
+  ckptfile=filename;
+  ckptwall=wallperiod;
+  ckptsim=simperiod;
+  ckptnext=tnow+simperiod;
+  ckptlast=std::chrono::steady_clock::now();
+}
+
+// CLASS Simulation: Returns 1 if a periodic checkpoint is due (the
+// wall clock is only read every CKPT_EVENTS events)
+
+int Simulation::CheckpointDue() {
+
+  std::chrono::duration<double> elapsed;
+
+  if ((ckptsim>0) && (tnow>=ckptnext)) {
+    while (ckptnext<=tnow) ckptnext+=ckptsim;
+    return 1;
+  }
+  if ((ckptwall>0) && ((nevents%CKPT_EVENTS)==0)) {
+    elapsed=std::chrono::steady_clock::now()-ckptlast;
+    if (elapsed.count()>=ckptwall) return 1;
+  }
+  return 0;
 }
 
 /////////////////////////////////////////////////////////////////////
-// CLASS SchedulerCell
+// CLASS Arena
 /////////////////////////////////////////////////////////////////////
 
-// CLASS SchedulerCell: Constructor
+// Chunk layout: link to next chunk, then objects (16-byte aligned)
 
-SchedulerCell::SchedulerCell(int code, float date, Client *cli) {
+#define ARENA_HEADER 16
 
-  eventcode=code;
-  eventdate=date;
-  client=cli;
+// CLASS Arena: Constructor
+
+Arena::Arena() {
+
+  int i;
+
+  first=NULL;
+  chunk=NULL;
+  ptr=NULL;
+  end=NULL;
+  for (i=0; i<ARENA_TYPES; i++) {
+    freelist[i]=NULL;
+    nalloc[i]=0;
+  }
+  nheap=0;
+}
+
+// CLASS Arena: Destructor
+
+Arena::~Arena() {
+
+  char *cour, *save;
+
+  cour=first;
+  while (cour!=NULL) {
+    save=cour;
+    cour=*(char **)cour;
+    free(save);
+  }
+}
+
+// CLASS Arena: Allocation of an object of a given type
+// (free list pop, or bump in the current chunk)
+
+void *Arena::Alloc(int type, size_t size) {
+
+  void *res;
+  char *next;
+
+  nalloc[type]++;
+
+  if (freelist[type]!=NULL) {
+    res=freelist[type];
+    freelist[type]=*(void **)res;
+    return res;
+  }
+
+  size=(size+15)&~(size_t)15;
+  if ((ptr==NULL) || (ptr+size>end)) {
+    if ((chunk!=NULL) && (*(char **)chunk!=NULL)) next=*(char **)chunk;
+    else {                                // New chunk from heap
+      next=(char *)malloc(ARENA_CHUNK);
+      *(char **)next=NULL;
+      if (chunk!=NULL) *(char **)chunk=next;
+      else first=next;
+      nheap++;
+    }
+    chunk=next;
+    ptr=chunk+ARENA_HEADER;
+    end=chunk+ARENA_CHUNK;
+  }
+  res=ptr;
+  ptr+=size;
+
+  return res;
+}
+
+// CLASS Arena: Release of an object (pushed on its type's free list)
+
+void Arena::Free(int type, void *obj) {
+
+  *(void **)obj=freelist[type];
+  freelist[type]=obj;
+}
+
+// CLASS Arena: Release of all objects (chunks are kept)
+
+void Arena::Release() {
+
+  int i;
+
+  chunk=first;
+  if (chunk!=NULL) {
+    ptr=chunk+ARENA_HEADER;
+    end=chunk+ARENA_CHUNK;
+  }
+  for (i=0; i<ARENA_TYPES; i++) freelist[i]=NULL;
+}
+
+// CLASS Arena: Returns the number of allocations of a type
+
+long Arena::Allocs(int type) {
+
+  if ((type>=0) && (type<ARENA_TYPES)) return nalloc[type];
+  else return -1;
+}
+
+// CLASS Arena: Returns the number of chunks taken from the heap
+
+long Arena::HeapAllocs() {
+
+  return nheap;
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLASS Scheduler
+/////////////////////////////////////////////////////////////////////
+
+// CLASS Scheduler: Constructor
+
+Scheduler::Scheduler(Arena *mem, int fel) {
+
+  switch(fel) {
+
+  case FEL_LIST:     list=new ListEventList(mem); break;
+  case FEL_HEAP:     list=new HeapEventList(2); break;
+  case FEL_HEAP4:    list=new HeapEventList(4); break;
+  case FEL_CALENDAR: list=new CalendarEventList(mem); break;
+  case FEL_LADDER:   list=new LadderEventList(mem); break;
+
+  default: LogError("Error: unknown event list #%d, using 4-ary heap\n",fel);
+           list=new HeapEventList(4);
+  }
+  seq=0;
+  current=-TIME_NEVER;
+  ringcapacity=16;
+  ring=new EventRecord[ringcapacity];
+  ringseq=new unsigned long[ringcapacity];
+  ringhead=0;
+  ringcount=0;
+  nscheduled=0;
+  nimmediate=0;
+}
+
+// CLASS Scheduler: Destructor
+
+Scheduler::~Scheduler() {
+
+  Purge();
+  delete list;
+  delete[] ring;
+  delete[] ringseq;
+}
+
+// CLASS Scheduler: Returns scheduler state
+// (1 if empty, 0 if not)
+
+int Scheduler::IsEmpty() {
+
+  return (ringcount==0) && list->IsEmpty();
+}
+
+// CLASS Scheduler: Insertion into scheduler
+// An event at the current date goes to the ring if the ring only
+// holds events at that date (their sequence numbers being smaller,
+// the ring stays sorted)
+
+void Scheduler::Schedule(int eventcode, SimTime eventdate, Client *client, int res) {
+
+  PendingEvent ev;
+  EventRecord *r;
+  unsigned long *rs;
+  int i, j;
+
+  ev.rec.date=eventdate;
+  ev.rec.code=eventcode;
+  ev.rec.resource=res;
+  ev.rec.client=(client!=NULL) ? client->handle : 0;
+  nscheduled++;
+  if ((eventdate==current) &&
+      ((ringcount==0) || (ring[ringhead].date==eventdate))) {
+    if (ringcount==ringcapacity) {      // Ring full: doubled, unrolled
+      r=new EventRecord[2*ringcapacity];
+      rs=new unsigned long[2*ringcapacity];
+      for (i=0; i<ringcount; i++) {
+        j=(ringhead+i)&(ringcapacity-1);
+        r[i]=ring[j];
+        rs[i]=ringseq[j];
+      }
+      delete[] ring;
+      delete[] ringseq;
+      ring=r;
+      ringseq=rs;
+      ringhead=0;
+      ringcapacity*=2;
+    }
+    i=(ringhead+ringcount)&(ringcapacity-1);
+    ring[i]=ev.rec;
+    ringseq[i]=seq++;
+    ringcount++;
+    nimmediate++;
+  } else {
+    ev.seq=seq++;
+    list->Insert(&ev);
+  }
+}
+
+// CLASS Scheduler: Insertion of event #code (checked at compile time)
+
+template <int code> void Scheduler::Schedule(SimTime eventdate, Client *client, int res) {
+
+  static_assert((code>=0) && (code<MAX_EVENTS),"event code out of range");
+  (void)&EventHandler<code>::Execute;     // code must have a handler
+  Schedule(code,eventdate,client,res);
+}
+
+// CLASS Scheduler: Takes the next event out (the ring's head or the
+// list's top, whichever precedes) and copies it to *ev
+// Returns 1 if successful, 0 if the scheduler is empty
+
+int Scheduler::PopNext(EventRecord *ev) {
+
+  PendingEvent *top=list->Top();
+
+  if ((ringcount>0) &&
+      ((top==NULL) || (ring[ringhead].date<top->rec.date) ||
+       ((ring[ringhead].date==top->rec.date) && (ringseq[ringhead]<top->seq)))) {
+    *ev=ring[ringhead];
+    ringhead=(ringhead+1)&(ringcapacity-1);
+    ringcount--;
+  } else if (top!=NULL) {
+    *ev=top->rec;
+    list->RemoveTop();
+  } else return 0;
+  current=ev->date;
+  return 1;
+}
+
+// CLASS Scheduler: Empties the scheduler
+
+void Scheduler::Purge() {
+
+  list->Purge();
+  ringhead=0;
+  ringcount=0;
+  current=-TIME_NEVER;
+  seq=0;
+}
+
+// CLASS Scheduler: Returns the number of events scheduled
+
+long Scheduler::Scheduled() {
+
+  return nscheduled;
+}
+
+// CLASS Scheduler: Returns the number of events scheduled at the
+// current date, which bypassed the sorted list
+
+long Scheduler::Immediate() {
+
+  return nimmediate;
+}
+
+// CLASS Scheduler: Writes the pending events (checkpoint; byhandle:
+// clients by event handle): events are taken out of the list in
+// execution order, written, then inserted again into the emptied
+// list (their sequence numbers are kept, so the order does not
+// change); the ring's events follow
+
+void Scheduler::Write(FILE *f, Client **byhandle) {
+
+  PendingEvent *buf, *larger, *top;
+  int n, count, capacity, i, j;
+
+  capacity=64;
+  buf=new PendingEvent[capacity];
+  count=0;
+  while ((top=list->Top())!=NULL) {
+    if (count==capacity) {
+      larger=new PendingEvent[2*capacity];
+      memcpy(larger,buf,count*sizeof(PendingEvent));
+      delete[] buf;
+      buf=larger;
+      capacity*=2;
+    }
+    buf[count++]=*top;
+    list->RemoveTop();
+  }
+
+  n=count+ringcount;
+  fwrite(&seq,sizeof(seq),1,f);
+  fwrite(&n,sizeof(n),1,f);
+  for (i=0; i<count; i++) {
+    WriteRecord(f,&buf[i].rec,buf[i].seq,byhandle);
+    list->Insert(buf+i);
+  }
+  delete[] buf;
+  for (i=0; i<ringcount; i++) {
+    j=(ringhead+i)&(ringcapacity-1);
+    WriteRecord(f,ring+j,ringseq[j],byhandle);
+  }
+}
+
+// CLASS Scheduler: Writes one event, its client given by id (see Read)
+
+void Scheduler::WriteRecord(FILE *f, EventRecord *ev, unsigned long s,
+                            Client **byhandle) {
+
+  int code, res, cid;
+
+  code=ev->code;
+  cid=(ev->client>0) ? byhandle[ev->client]->id : 0;
+  res=ev->resource;
+  fwrite(&code,sizeof(code),1,f);
+  fwrite(&ev->date,sizeof(ev->date),1,f);
+  fwrite(&cid,sizeof(cid),1,f);
+  fwrite(&res,sizeof(res),1,f);
+  fwrite(&s,sizeof(s),1,f);
+}
+
+// CLASS Scheduler: Reads the events written by Write() (byid[1..n]:
+// clients by id, with their handles); returns 1 if successful, 0
+// otherwise
+
+int Scheduler::Read(FILE *f, Client **byid, int n) {
+
+  PendingEvent ev;
+  int ok=1, count, i, code, res, cid;
+
+  Purge();
+  ok&=(fread(&seq,sizeof(seq),1,f)==1);
+  ok&=(fread(&count,sizeof(count),1,f)==1);
+  for (i=0; ok && (i<count); i++) {
+    ok&=(fread(&code,sizeof(code),1,f)==1);
+    ok&=(fread(&ev.rec.date,sizeof(ev.rec.date),1,f)==1);
+    ok&=(fread(&cid,sizeof(cid),1,f)==1);
+    ok&=(fread(&res,sizeof(res),1,f)==1);
+    ok&=(fread(&ev.seq,sizeof(ev.seq),1,f)==1);
+    if (ok && ((cid<0) || (cid>n) || ((cid>0) && (byid[cid]==NULL)))) ok=0;
+    if (ok && ((code<0) || (code>=NEVENTS) || (res<-1) || (res>=MAX_RESOURCES))) ok=0;
+    if (!ok) break;
+    ev.rec.code=code;
+    ev.rec.resource=res;
+    ev.rec.client=(cid>0) ? byid[cid]->handle : 0;
+    list->Insert(&ev);
+  }
+  return ok;
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLASS SchedulerCell
+/////////////////////////////////////////////////////////////////////
+
+// Event ordering: by date, then by sequence number
+// (1 if a must be executed before b, 0 if not)
+
+int EventPrecedes(PendingEvent *a, PendingEvent *b) {
+
+  if (a->rec.date<b->rec.date) return 1;
+  if (a->rec.date>b->rec.date) return 0;
+  return (a->seq<b->seq);
+}
+
+// CLASS SchedulerCell: Constructor
+
+SchedulerCell::SchedulerCell(PendingEvent *e) {
+
+  ev=*e;
   next=NULL;
   previous=NULL;
 }
 
-// CLASS SchedulerCell: Returns event code
+// CLASS SchedulerCell: Returns event date
+
+SimTime SchedulerCell::Date() {
+
+  return ev.rec.date;
+}
+
+// CLASS SchedulerCell: Returns event
+
+PendingEvent *SchedulerCell::Event() {
+
+  return &ev;
+}
+
+// CLASS SchedulerCell: Event ordering
+// (1 if this cell must be executed before cell, 0 if not)
+
+int SchedulerCell::Precedes(SchedulerCell *cell) {
+
+  return EventPrecedes(&ev,&cell->ev);
+}
+
+// CLASS SchedulerCell: Returns next cell
+
+SchedulerCell *SchedulerCell::Next() {
+
+  return next;
+}
+
+// CLASS SchedulerCell: Returns previous cell
+
+SchedulerCell *SchedulerCell::Previous() {
+
+  return previous;
+}
+
+// CLASS SchedulerCell: Reintitialize pointer toward next cell
+
+void SchedulerCell::SetNext(SchedulerCell *newnext) {
+
+  next=newnext;
+}
+
+// CLASS SchedulerCell: Reintitialize pointer toward previous cell
+
+void SchedulerCell::SetPrevious(SchedulerCell *newprev) {
+
+  previous=newprev;
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLASS EventList
+/////////////////////////////////////////////////////////////////////
+
+// CLASS EventList: Destructor
+
+EventList::~EventList() {
+
+}
+
+// Comparison function for qsort() on arrays of cells
+
+int CellOrder(const void *a, const void *b) {
+
+  SchedulerCell *ca=*(SchedulerCell **)a;
+  SchedulerCell *cb=*(SchedulerCell **)b;
+
+  if (ca->Precedes(cb)) return -1;
+  else if (cb->Precedes(ca)) return 1;
+  else return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLASS ListEventList
+/////////////////////////////////////////////////////////////////////
+
+// CLASS ListEventList: Constructor
+
+ListEventList::ListEventList(Arena *mem) {
+
+  arena=mem;
+  top=NULL;
+  bottom=NULL;
+}
+
+// CLASS ListEventList: Destructor
+
+ListEventList::~ListEventList() {
+
+  Purge();
+}
+
+// CLASS ListEventList: Returns list state
+// (1 if empty, 0 if not)
+
+int ListEventList::IsEmpty() {
+
+  if (top==NULL) return 1;
+  else return 0;
+}
+
+// CLASS ListEventList: Insertion (from the bottom)
+
+void ListEventList::Insert(PendingEvent *ev) {
+
+  SchedulerCell *nouv, *prec, *cour;
+
+  nouv=new (arena->Alloc(ARENA_CELL,sizeof(SchedulerCell))) SchedulerCell(ev);
+  prec=NULL;
+  cour=bottom;
+
+  while ((cour!=NULL) && (nouv->Precedes(cour))) {
+    prec=cour;
+    cour=cour->Previous();
+  }
+
+  nouv->SetPrevious(cour);
+  nouv->SetNext(prec);
+
+  if (prec!=NULL) prec->SetPrevious(nouv);
+  else bottom=nouv;
+  if (cour!=NULL) cour->SetNext(nouv);
+  else top=nouv;
+}
+
+// CLASS ListEventList: Returns 1st event
+
+PendingEvent *ListEventList::Top() {
+
+  if (top!=NULL) return top->Event();
+  else return NULL;
+}
+
+// CLASS ListEventList: Unlinks and frees 1st cell
+
+void ListEventList::RemoveTop() {
+
+  SchedulerCell *sauve;
+
+  sauve=top;
+  if (top==NULL) return;
+  if (top->Next()!=NULL) {
+    top=top->Next();
+    top->SetPrevious(NULL);
+  } else {
+    top=NULL;
+    bottom=NULL;
+  }
+  arena->Free(ARENA_CELL,sauve);
+}
+
+// CLASS ListEventList: Drops all cells
+
+void ListEventList::Purge() {
+
+  top=NULL;
+  bottom=NULL;
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLASS HeapEventList
+/////////////////////////////////////////////////////////////////////
+
+// CLASS HeapEventList: Constructor
+
+HeapEventList::HeapEventList(int d) {
+
+  if (d<2) d=2;
+  arity=d;
+  size=0;
+  capacity=64;
+  heap=new PendingEvent[capacity];
+}
+
+// CLASS HeapEventList: Destructor
+
+HeapEventList::~HeapEventList() {
+
+  Purge();
+  delete[] heap;
+}
+
+// CLASS HeapEventList: Returns list state
+// (1 if empty, 0 if not)
+
+int HeapEventList::IsEmpty() {
+
+  if (size==0) return 1;
+  else return 0;
+}
+
+// CLASS HeapEventList: Insertion (sift up)
+
+void HeapEventList::Insert(PendingEvent *nouv) {
+
+  PendingEvent *larger;
+  int i, parent;
+
+  if (size==capacity) {
+    larger=new PendingEvent[2*capacity];
+    memcpy(larger,heap,size*sizeof(PendingEvent));
+    delete[] heap;
+    heap=larger;
+    capacity*=2;
+  }
+
+  i=size++;
+  while (i>0) {
+    parent=(i-1)/arity;
+    if (!EventPrecedes(nouv,heap+parent)) break;
+    heap[i]=heap[parent];
+    i=parent;
+  }
+  heap[i]=*nouv;
+}
+
+// CLASS HeapEventList: Returns 1st event
+
+PendingEvent *HeapEventList::Top() {
+
+  if (size>0) return heap;
+  else return NULL;
+}
+
+// CLASS HeapEventList: Deletes 1st event (sift down)
+
+void HeapEventList::RemoveTop() {
+
+  PendingEvent last;
+  int i, child, best, end;
+
+  if (size==0) return;
+  last=heap[--size];
+
+  i=0;
+  while ((child=arity*i+1)<size) {
+    best=child;
+    end=child+arity;
+    if (end>size) end=size;
+    for (child++; child<end; child++)
+      if (EventPrecedes(heap+child,heap+best)) best=child;
+    if (!EventPrecedes(heap+best,&last)) break;
+    heap[i]=heap[best];
+    i=best;
+  }
+  heap[i]=last;
+}
+
+// CLASS HeapEventList: Deletes all events
+
+void HeapEventList::Purge() {
+
+  size=0;
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLASS CalendarEventList
+/////////////////////////////////////////////////////////////////////
+
+// CLASS CalendarEventList: Constructor
+
+CalendarEventList::CalendarEventList(Arena *mem) {
+
+  int i;
+
+  arena=mem;
+  nbuckets=2;
+  bucketcapacity=2;
+  bucket=new SchedulerCell*[bucketcapacity];
+  for (i=0; i<nbuckets; i++) bucket[i]=NULL;
+  size=0;
+  width=1.0;
+  sortbuf=NULL;
+  sortcapacity=0;
+  cache=NULL;
+  Locate(0);
+}
+
+// CLASS CalendarEventList: Destructor
+
+CalendarEventList::~CalendarEventList() {
+
+  Purge();
+  delete[] bucket;
+  delete[] sortbuf;
+}
+
+// CLASS CalendarEventList: Returns list state
+// (1 if empty, 0 if not)
+
+int CalendarEventList::IsEmpty() {
+
+  if (size==0) return 1;
+  else return 0;
+}
+
+// CLASS CalendarEventList: Returns day number of a date
+
+long long CalendarEventList::Day(double date) {
+
+  return (long long)floor(date/width);
+}
+
+// CLASS CalendarEventList: Sets the current day
+
+void CalendarEventList::Locate(double date) {
+
+  lastdate=date;
+  lastday=Day(date);
+  lastbucket=(int)(((lastday%nbuckets)+nbuckets)%nbuckets);
+}
+
+// CLASS CalendarEventList: Sorted insertion into the cell's bucket
+
+void CalendarEventList::Link(SchedulerCell *nouv) {
+
+  SchedulerCell *prec, *cour;
+  long long day=Day(nouv->Date());
+  int i=(int)(((day%nbuckets)+nbuckets)%nbuckets);
+
+  prec=NULL;
+  cour=bucket[i];
+  while ((cour!=NULL) && (!nouv->Precedes(cour))) {
+    prec=cour;
+    cour=cour->Next();
+  }
+
+  nouv->SetNext(cour);
+  if (prec!=NULL) prec->SetNext(nouv);
+  else bucket[i]=nouv;
+}
+
+// CLASS CalendarEventList: Insertion
+
+void CalendarEventList::Insert(PendingEvent *ev) {
+
+  SchedulerCell *nouv;
+
+  nouv=new (arena->Alloc(ARENA_CELL,sizeof(SchedulerCell))) SchedulerCell(ev);
+  if ((cache!=NULL) && (nouv->Precedes(cache))) cache=NULL;
+  if (nouv->Date()<lastdate) {            // Event in the past
+    Locate(nouv->Date());
+    cache=NULL;
+  }
+
+  Link(nouv);
+  size++;
+  if (size>2*nbuckets) Resize(2*nbuckets);
+}
+
+// CLASS CalendarEventList: Returns 1st event
+
+PendingEvent *CalendarEventList::Top() {
+
+  SchedulerCell *cell=First();
+
+  if (cell!=NULL) return cell->Event();
+  else return NULL;
+}
+
+// CLASS CalendarEventList: Returns 1st cell
+// (scans one year of buckets, then falls back on a direct search)
+
+SchedulerCell *CalendarEventList::First() {
+
+  long long day;
+  int i, k;
+
+  if (cache!=NULL) return cache;
+  if (size==0) return NULL;
+
+  i=lastbucket;
+  day=lastday;
+  for (k=0; k<nbuckets; k++) {
+    if ((bucket[i]!=NULL) && (Day(bucket[i]->Date())<=day)) {
+      cache=bucket[i];
+      cachebucket=i;
+      cacheday=day;
+      return cache;
+    }
+    if (++i==nbuckets) i=0;
+    day++;
+  }
+
+  // Direct search
+  for (i=0; i<nbuckets; i++)
+    if ((bucket[i]!=NULL) && ((cache==NULL) || (bucket[i]->Precedes(cache)))) {
+      cache=bucket[i];
+      cachebucket=i;
+    }
+  cacheday=Day(cache->Date());
+
+  return cache;
+}
+
+// CLASS CalendarEventList: Unlinks and frees 1st cell
+
+void CalendarEventList::RemoveTop() {
+
+  SchedulerCell *res=First();
+
+  if (res==NULL) return;
+
+  bucket[cachebucket]=res->Next();
+  res->SetNext(NULL);
+  lastbucket=cachebucket;
+  lastday=cacheday;
+  lastdate=res->Date();
+  cache=NULL;
+  size--;
+  arena->Free(ARENA_CELL,res);
+  if ((nbuckets>2) && (size<nbuckets/2)) Resize(nbuckets/2);
+}
+
+// CLASS CalendarEventList: Rebuilds the calendar with newsize buckets
+// Day width is 3 times the average separation of the first events.
+
+void CalendarEventList::Resize(int newsize) {
+
+  SchedulerCell *cour;
+  double avg, sum, sep;
+  int i, n, k, nsep;
+
+  // Gathering and sorting cells
+  if (size>sortcapacity) {
+    delete[] sortbuf;
+    sortcapacity=2*size;
+    sortbuf=new SchedulerCell*[sortcapacity];
+  }
+  n=0;
+  for (i=0; i<nbuckets; i++)
+    for (cour=bucket[i]; cour!=NULL; cour=cour->Next()) sortbuf[n++]=cour;
+  qsort(sortbuf,n,sizeof(SchedulerCell *),CellOrder);
+
+  // New width
+  k=n;
+  if (k>25) k=25;
+  if (k>1) {
+    avg=(sortbuf[k-1]->Date()-sortbuf[0]->Date())/(k-1);
+    sum=0;
+    nsep=0;
+    for (i=1; i<k; i++) {
+      sep=sortbuf[i]->Date()-sortbuf[i-1]->Date();
+      if (sep<=2*avg) {
+        sum+=sep;
+        nsep++;
+      }
+    }
+    if ((nsep>0) && (sum>0)) width=3*sum/nsep;
+  }
+
+  // New buckets (reverse order insertion on top keeps buckets sorted)
+  if (newsize>bucketcapacity) {
+    delete[] bucket;
+    bucketcapacity=newsize;
+    bucket=new SchedulerCell*[bucketcapacity];
+  }
+  nbuckets=newsize;
+  for (i=0; i<nbuckets; i++) bucket[i]=NULL;
+  for (i=n-1; i>=0; i--) {
+    k=(int)(((Day(sortbuf[i]->Date())%nbuckets)+nbuckets)%nbuckets);
+    sortbuf[i]->SetNext(bucket[k]);
+    bucket[k]=sortbuf[i];
+  }
+
+  Locate(lastdate);
+  cache=NULL;
+}
+
+// CLASS CalendarEventList: Drops all cells
+
+void CalendarEventList::Purge() {
+
+  int i;
+
+  for (i=0; i<nbuckets; i++) bucket[i]=NULL;
+
+  size=0;
+  cache=NULL;
+  Locate(0);
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLASS LadderEventList
+/////////////////////////////////////////////////////////////////////
+
+// CLASS LadderEventList: Constructor
+
+LadderEventList::LadderEventList(Arena *mem) {
+
+  int r;
+
+  arena=mem;
+  for (r=0; r<LADDER_RUNGS; r++) {
+    rung[r]=NULL;
+    rcount[r]=NULL;
+    rcapacity[r]=0;
+  }
+  sortbuf=NULL;
+  sortcapacity=0;
+  toplist=NULL;
+  nrungs=0;
+  bottom=NULL;
+  bottomlast=NULL;
+  Purge();
+}
+
+// CLASS LadderEventList: Destructor
+
+LadderEventList::~LadderEventList() {
+
+  int r;
+
+  Purge();
+  for (r=0; r<LADDER_RUNGS; r++) {
+    delete[] rung[r];
+    delete[] rcount[r];
+  }
+  delete[] sortbuf;
+}
+
+// CLASS LadderEventList: Returns list state
+// (1 if empty, 0 if not)
+
+int LadderEventList::IsEmpty() {
+
+  if (size==0) return 1;
+  else return 0;
+}
+
+// CLASS LadderEventList: Returns bucket of date in rung r
+
+int LadderEventList::Index(int r, double date) {
+
+  int i=(int)((date-rstart[r])/rwidth[r]);
+
+  if (i<rcur[r]) i=rcur[r];
+  if (i>=rsize[r]) i=rsize[r]-1;
+  return i;
+}
+
+// CLASS LadderEventList: Insertion
+
+void LadderEventList::Insert(PendingEvent *ev) {
+
+  SchedulerCell *nouv;
+  double date=ev->rec.date;
+  int r, i;
+
+  nouv=new (arena->Alloc(ARENA_CELL,sizeof(SchedulerCell))) SchedulerCell(ev);
+  size++;
+
+  // Top
+  if (date>=topstart) {
+    nouv->SetNext(toplist);
+    toplist=nouv;
+    if (date<topmin) topmin=date;
+    if (date>topmax) topmax=date;
+    topcount++;
+    return;
+  }
+
+  // Rungs
+  for (r=0; r<nrungs; r++)
+    if (date>=rstart[r]+rcur[r]*rwidth[r]) {
+      i=Index(r,date);
+      nouv->SetNext(rung[r][i]);
+      rung[r][i]=nouv;
+      rcount[r][i]++;
+      return;
+    }
+
+  // Bottom
+  BottomInsert(nouv);
+}
+
+// CLASS LadderEventList: Sorted insertion into bottom (from the end)
+
+void LadderEventList::BottomInsert(SchedulerCell *nouv) {
+
+  SchedulerCell *prec, *cour;
+
+  prec=NULL;
+  cour=bottomlast;
+
+  while ((cour!=NULL) && (nouv->Precedes(cour))) {
+    prec=cour;
+    cour=cour->Previous();
+  }
+
+  nouv->SetPrevious(cour);
+  nouv->SetNext(prec);
+
+  if (prec!=NULL) prec->SetPrevious(nouv);
+  else bottomlast=nouv;
+  if (cour!=NULL) cour->SetNext(nouv);
+  else bottom=nouv;
+}
+
+// CLASS LadderEventList: Creates a new rung from an unsorted list
+
+void LadderEventList::Spawn(SchedulerCell *list, int count, double start, double w) {
+
+  SchedulerCell *cour, *next;
+  int r=nrungs++, i, nb=count+1;
+
+  if (nb>rcapacity[r]) {
+    delete[] rung[r];
+    delete[] rcount[r];
+    rcapacity[r]=2*nb;
+    rung[r]=new SchedulerCell*[rcapacity[r]];
+    rcount[r]=new int[rcapacity[r]];
+  }
+  for (i=0; i<nb; i++) {
+    rung[r][i]=NULL;
+    rcount[r][i]=0;
+  }
+  rsize[r]=nb;
+  rstart[r]=start;
+  rwidth[r]=w;
+  rcur[r]=0;
+
+  for (cour=list; cour!=NULL; cour=next) {
+    next=cour->Next();
+    i=Index(r,cour->Date());
+    cour->SetNext(rung[r][i]);
+    rung[r][i]=cour;
+    rcount[r][i]++;
+  }
+}
+
+// CLASS LadderEventList: Sorts an unsorted list into (empty) bottom
+
+void LadderEventList::Sort(SchedulerCell *list, int count) {
 
-int SchedulerCell::Code() {
+  SchedulerCell *cour;
+  int i;
 
-  return eventcode;
+  if (count>sortcapacity) {
+    delete[] sortbuf;
+    sortcapacity=2*count;
+    sortbuf=new SchedulerCell*[sortcapacity];
+  }
+  i=0;
+  for (cour=list; cour!=NULL; cour=cour->Next()) sortbuf[i++]=cour;
+  qsort(sortbuf,count,sizeof(SchedulerCell *),CellOrder);
+
+  for (i=0; i<count; i++) {
+    if (i>0) sortbuf[i]->SetPrevious(sortbuf[i-1]);
+    else sortbuf[i]->SetPrevious(NULL);
+    if (i<count-1) sortbuf[i]->SetNext(sortbuf[i+1]);
+    else sortbuf[i]->SetNext(NULL);
+  }
+  bottom=sortbuf[0];
+  bottomlast=sortbuf[count-1];
 }
 
-// CLASS SchedulerCell: Returns event date
+// CLASS LadderEventList: Refills bottom from the rungs (or from top)
 
-float SchedulerCell::Date() {
+void LadderEventList::Prepare() {
 
-  return eventdate;
-}
+  SchedulerCell *list, *cour;
+  double bstart, dmin, dmax;
+  int r, b, count;
 
-// CLASS SchedulerCell: Returns pointer toward client
+  while ((bottom==NULL) && (size>0)) {
 
-Client *SchedulerCell::Cli() {
+    if (nrungs==0) {                      // Top -> 1st rung
+      list=toplist;
+      count=topcount;
+      topstart=topmax;
+      if ((count>LADDER_THRES) && (topmax>topmin))
+        Spawn(list,count,topmin,(topmax-topmin)/count);
+      else Sort(list,count);
+      toplist=NULL;
+      topcount=0;
+      topmin=HUGE_VAL;
+      topmax=-HUGE_VAL;
+      continue;
+    }
 
-  return client;
+    // Next non-empty bucket in the lowest rung
+    r=nrungs-1;
+    while ((rcur[r]<rsize[r]) && (rcount[r][rcur[r]]==0)) rcur[r]++;
+    if (rcur[r]>=rsize[r]) {
+      nrungs--;
+      continue;
+    }
+    b=rcur[r]++;
+    list=rung[r][b];
+    count=rcount[r][b];
+    rung[r][b]=NULL;
+    rcount[r][b]=0;
+    bstart=rstart[r]+b*rwidth[r];
+
+    if ((count>LADDER_THRES) && (nrungs<LADDER_RUNGS)) {
+      dmin=HUGE_VAL;
+      dmax=-HUGE_VAL;
+      for (cour=list; cour!=NULL; cour=cour->Next()) {
+        if (cour->Date()<dmin) dmin=cour->Date();
+        if (cour->Date()>dmax) dmax=cour->Date();
+      }
+      if (dmax>dmin) {
+        Spawn(list,count,bstart,rwidth[r]/count);
+        continue;
+      }
+    }
+    Sort(list,count);
+  }
 }
 
-// CLASS SchedulerCell: Returns next cell
+// CLASS LadderEventList: Returns 1st event
 
-SchedulerCell *SchedulerCell::Next() {
+PendingEvent *LadderEventList::Top() {
 
-  return next;
+  Prepare();
+  if (bottom!=NULL) return bottom->Event();
+  else return NULL;
 }
 
-// CLASS SchedulerCell: Returns previous cell
-
-SchedulerCell *SchedulerCell::Previous() {
+// CLASS LadderEventList: Unlinks and frees 1st cell
 
-  return previous;
-}
+void LadderEventList::RemoveTop() {
 
-// CLASS SchedulerCell: Reintitialize pointer toward next cell
+  SchedulerCell *res;
 
-void SchedulerCell::SetNext(SchedulerCell *newnext) {
+  Prepare();
+  res=bottom;
+  if (res==NULL) return;
 
-  next=newnext;
+  bottom=res->Next();
+  if (bottom!=NULL) bottom->SetPrevious(NULL);
+  else bottomlast=NULL;
+  size--;
+  arena->Free(ARENA_CELL,res);
 }
 
-// CLASS SchedulerCell: Reintitialize pointer toward previous cell
+// CLASS LadderEventList: Drops all cells
 
-void SchedulerCell::SetPrevious(SchedulerCell *newprev) {
+void LadderEventList::Purge() {
 
-  previous=newprev;
+  int r, i;
+
+  for (r=0; r<nrungs; r++)
+    for (i=rcur[r]; i<rsize[r]; i++) {
+      rung[r][i]=NULL;
+      rcount[r][i]=0;
+    }
+
+  toplist=NULL;
+  topcount=0;
+  topmin=HUGE_VAL;
+  topmax=-HUGE_VAL;
+  topstart=-HUGE_VAL;
+  nrungs=0;
+  bottom=NULL;
+  bottomlast=NULL;
+  size=0;
 }
 
 /////////////////////////////////////////////////////////////////////
@@ -355,35 +2211,60 @@ void SchedulerCell::SetPrevious(SchedulerCell *newprev) {
 
 Resource::Resource(char n[STRS], int cap, Simulation *sim) {
 
+  int i;
+
   strcpy(name,n);
   capacity=cap;
   simul=sim;
-  top=NULL;
-  bottom=NULL;
+  id=sim->Register(this);
+  for (i=0; i<PRIORITIES; i++) {
+    rings[i].cells=NULL;
+    rings[i].head=0;
+    rings[i].count=0;
+    rings[i].capacity=0;
+  }
+  levels=0;
+  occupancy=NULL;
+  ncontrols=0;
+  batches=NULL;
+  nbatches=0;
+  batchcap=0;
+  binstart=NULL;
+  binindex=NULL;
+  bincount=NULL;
+  nbins=0;
+  bincap=0;
+  batchsize=0;
+  batchoverlap=0;
+  batchr1=0;
 }
 
 // CLASS Resource: Destructor
 
 Resource::~Resource() {
 
-  PurgeQueue();
+  int i;
+
+  for (i=0; i<PRIORITIES; i++) delete[] rings[i].cells;
+  delete occupancy;
+  delete[] batches;
+  delete[] binstart;
+  delete[] binindex;
+  delete[] bincount;
+  simul->Unregister(id);
 }
 
-// CLASS Resource: Empties queue
+// CLASS Resource: Empties queue (rings are kept)
 
 void Resource::PurgeQueue() {
 
-  QueueCell *cour, *save;
+  int i;
 
-  cour=bottom;
-  while (cour!=NULL) {
-    save=cour;
-    cour=cour->Next();
-    delete save;
+  for (i=0; i<PRIORITIES; i++) {
+    rings[i].head=0;
+    rings[i].count=0;
   }
-
-  top=NULL;
-  bottom=NULL;
+  levels=0;
 }
 
 // CLASS Resource: Resource reservation (P)
@@ -391,37 +2272,122 @@ void Resource::PurgeQueue() {
 void Resource::P(int event, Client *client, int prior) {
 
   ccapacity--;
+  Levels();
+  client->pdate=simul->Tnow();
   if (ccapacity>=0) {                    // Immediate action
-    response-=simul->Tnow();
-    simul->Sched()->Schedule(event,simul->Tnow(),client);
+    waits.Add(0);
+    response-=Units(simul->Tnow());
+    simul->Sched()->Schedule(event,simul->Tnow(),client,id);
   } else {                               // Event is put in queue
-    wait-=simul->Tnow();
-    EnQueue(event,client,prior);
+    wait-=Units(simul->Tnow());
+    EnQueue(event,client,prior,simul->Tnow());
   }
 }
 
+// CLASS Resource: Reservation for event #code (checked at compile time)
+
+template <int code> void Resource::P(Client *client, int prior) {
+
+  (void)&EventHandler<code>::Execute;     // code must have a handler
+  P(code,client,prior);
+}
+
 // CLASS Resource: Resource liberation (V)
 
 void Resource::V() {
 
-  Client *nextclient;
+  QueueCell next;
 
   ccapacity++;
   if (ccapacity>capacity) {
-    printf("Error: capacity overflow for resource %s at time %f\n",name,simul->Tnow());
+    LogError("Error: capacity overflow for resource %s at time %f\n",name,(double)Units(simul->Tnow()));
     ccapacity=capacity;
   }
-  response+=simul->Tnow();
+  Levels();
+  response+=Units(simul->Tnow());
   nbserv++;
-  if (!QueueEmpty()) {                  // Queue not empty
-    nextclient=GetClient();
-    wait+=simul->Tnow();
-    response-=simul->Tnow();
-    simul->Sched()->Schedule(GetEventCode(),simul->Tnow(),nextclient);
-    DestroyTop();
+  if (DeQueue(&next)) {                 // Queue not empty
+    waits.Add(Units(simul->Tnow()-next.date));
+    wait+=Units(simul->Tnow());
+    response-=Units(simul->Tnow());
+    simul->Sched()->Schedule(next.code,simul->Tnow(),next.client,id);
+  }
+}
+
+// CLASS Resource: Resource liberation by a client (V), which gives
+// its sojourn time (from its P: waiting plus service)
+
+void Resource::V(Client *client) {
+
+  sojourns.Add(Units(simul->Tnow()-client->pdate));
+  V();
+}
+
+// CLASS Resource: Updates the time-weighted numbers of busy servers
+// and waiting clients (after each change of ccapacity)
+
+void Resource::Levels() {
+
+  if (ccapacity>=0) {
+    busy.Set(Units(simul->Tnow()),capacity-ccapacity);
+    waiting.Set(Units(simul->Tnow()),0);
+  } else {
+    busy.Set(Units(simul->Tnow()),capacity);
+    waiting.Set(Units(simul->Tnow()),-ccapacity);
   }
 }
 
+// CLASS Resource: Tracks the time spent in states 0..nstates-1 (at
+// most MAX_STATES) of a model variable, set with SetState()
+
+void Resource::TrackState(int nstates) {
+
+  if (nstates>MAX_STATES) nstates=MAX_STATES;
+  delete occupancy;
+  occupancy=new Occupancy(nstates);
+}
+
+// CLASS Resource: Tracked state becomes state at Tnow
+
+void Resource::SetState(int state) {
+
+  if (occupancy!=NULL) occupancy->Set(Units(simul->Tnow()),state);
+}
+
+// CLASS Resource: Registers a control variate: a model quantity of
+// known mean mu, observed with Observe(). Its replication average
+// becomes statistic STAT_CTRL+c, and Adjusted() uses the controls to
+// narrow the confidence intervals of the other statistics. Returns
+// its number c (-1 if MAX_CONTROLS are already registered).
+
+int Resource::AddControl(const char *n, double mu) {
+
+  if (ncontrols>=MAX_CONTROLS) return -1;
+  strncpy(ctrlname[ncontrols],n,STRS-1);
+  ctrlname[ncontrols][STRS-1]=0;
+  ctrlmean[ncontrols]=mu;
+  ctrlsum[ncontrols]=0;
+  ctrln[ncontrols]=0;
+  return ncontrols++;
+}
+
+// CLASS Resource: New known mean of control variate #c (e.g. after
+// a change of the model parameters, before the replications)
+
+void Resource::SetControl(int c, double mu) {
+
+  if ((c>=0) && (c<ncontrols)) ctrlmean[c]=mu;
+}
+
+// CLASS Resource: New observation of control variate #c
+
+void Resource::Observe(int c, double x) {
+
+  if ((c<0) || (c>=ncontrols)) return;
+  ctrlsum[c]+=x;
+  ctrln[c]++;
+}
+
 // CLASS Resource: Returns simulation object address
 
 Simulation *Resource::Sim() {
@@ -433,23 +2399,37 @@ Simulation *Resource::Sim() {
 
 void Resource::ResetCounters() {
 
+  int i;
+
   ccapacity=capacity;
   response=0;
   wait=0;
   nbserv=0;
+  waits.Reset();
+  sojourns.Reset();
+  busy.Reset(Units(simul->Tnow()),0);
+  waiting.Reset(Units(simul->Tnow()),0);
+  if (occupancy!=NULL) occupancy->Reset(Units(simul->Tnow()),0);
+  for (i=0; i<ncontrols; i++) {
+    ctrlsum[i]=0;
+    ctrln[i]=0;
+  }
 }
 
 // CLASS Resource: Global stats initialization 
 
 void Resource::ResetStats() {
 
-  int i;
+  int i, j;
 
-  for (i=0; i<5; i++) {
-    stats[i]=0;
-    stats2[i]=0;
-  }
-  n=0;
+  for (i=0; i<NSTATS; i++) acc[i].Reset();
+  for (j=0; j<ncontrols; j++)
+    for (i=0; i<NSTATS; i++) cov[j][i].Reset();
+  allwaits.Reset();
+  allsojourns.Reset();
+  nbatches=0;
+  nbins=0;
+  batchsize=0;
 
 }
 
@@ -457,8 +2437,18 @@ void Resource::ResetStats() {
 
 void Resource::Stats() {
 
+  double s[NSTATS];
+
+  Sample(s);
+  Accumulate(s);
+  Collect();
+}
+
+// CLASS Resource: Statistics of the current replication
+
+void Resource::Sample(double s[NSTATS]) {
+
   int nbwait, nbbs, i;
-  float s[5];
 
   if (ccapacity<0) {
     nbwait=-ccapacity;
@@ -468,11 +2458,12 @@ void Resource::Stats() {
     nbbs=capacity-ccapacity;
   }
 
-  // Response time (for the current replication)
-  if (nbserv!=0) s[0]=(response+nbbs*Sim()->Tnow())/nbserv;
+  // Response time (for the current replication): from the start of
+  // service to V, as in DESP-C++ 1.1
+  if (nbserv!=0) s[0]=(response+nbbs*Units(Sim()->Tnow()))/nbserv;
   else s[0]=0;
   // Waiting time (for the current replication)
-  if ((nbserv+nbbs)!=0) s[1]=(wait+nbwait*Sim()->Tnow())/(nbserv+nbbs);
+  if ((nbserv+nbbs)!=0) s[1]=(wait+nbwait*Units(Sim()->Tnow()))/(nbserv+nbbs);
   else s[1]=0;
   // Served (for the current replication)
   s[2]=nbserv;
@@ -480,32 +2471,194 @@ void Resource::Stats() {
   s[3]=nbbs;
   // Waiting (for the replication)
   s[4]=nbwait;
+  // Per-client sojourn (P to V) and waiting times quantiles (for the replication)
+  s[5]=sojourns.Quantile(0.5);
+  s[6]=sojourns.Quantile(0.9);
+  s[7]=sojourns.Quantile(0.99);
+  s[8]=sojourns.Max();
+  s[9]=waits.Quantile(0.5);
+  s[10]=waits.Quantile(0.9);
+  s[11]=waits.Quantile(0.99);
+  s[12]=waits.Max();
+  // Time averages (for the replication)
+  s[13]=busy.Mean(Units(Sim()->Tnow()))/capacity;
+  s[14]=busy.Mean(Units(Sim()->Tnow()))+waiting.Mean(Units(Sim()->Tnow()));
+  s[15]=waiting.Mean(Units(Sim()->Tnow()));
+  // Occupancy of tracked states (for the replication)
+  for (i=0; i<MAX_STATES; i++)
+    if (occupancy!=NULL) s[STAT_OCC+i]=occupancy->Fraction(Units(Sim()->Tnow()),i);
+    else s[STAT_OCC+i]=0;
+  // Control variates averages (for the replication; the known mean
+  // if there was no observation, so that it does not bias Adjusted)
+  for (i=0; i<MAX_CONTROLS; i++)
+    if ((i<ncontrols) && (ctrln[i]>0)) s[STAT_CTRL+i]=ctrlsum[i]/ctrln[i];
+    else if (i<ncontrols) s[STAT_CTRL+i]=ctrlmean[i];
+    else s[STAT_CTRL+i]=0;
+}
+
+// CLASS Resource: Addition of the statistics of one replication
+
+void Resource::Accumulate(double s[NSTATS]) {
+
+  int i, j;
+
+  for (i=0; i<NSTATS; i++) acc[i].Add(s[i]);
+  for (j=0; j<ncontrols; j++)
+    for (i=0; i<NSTATS; i++) cov[j][i].Add(s[STAT_CTRL+j],s[i]);
+}
+
+// CLASS Resource: Returns the 0.95 confidence interval half-width of
+// statistic #i (0 if less than 2 replications)
 
-  // Additions
-  for (i=0; i<5; i++) {
-    stats[i]+=s[i];
-    stats2[i]+=s[i]*s[i];
+double Resource::HalfWidth(short i) {
+
+  long n;
+
+  if ((i<0) || (i>=NSTATS)) return -1;
+  n=acc[i].Count();
+  if (batchoverlap && (batchsize>1) && (n>1) && ((i<5) || (i>12)))
+    return OverlapHalfWidth(i);         // Quantiles: non-overlapping only
+  if (n>1) return t(n-1)*sqrt(acc[i].Variance())/sqrt(n);
+  else return 0;
+}
+
+// CLASS Resource: Returns statistic #i adjusted by the control
+// variates, and its 0.95 confidence interval half-width in *hw
+// (multiple control variates: Y-beta.(C-mu), beta fitted by least
+// squares over the replications; Lavenberg & Welch). Without
+// controls, or with too few replications, returns the plain mean.
+
+double Resource::Adjusted(short i, double *hw) {
+
+  double a[MAX_CONTROLS*MAX_CONTROLS], beta[MAX_CONTROLS];
+  double d[MAX_CONTROLS], e[MAX_CONTROLS];
+  double sse, q, y;
+  long n;
+  int m, j, k;
+
+  *hw=HalfWidth(i);
+  if ((i<0) || (i>=NSTATS)) return -1;
+  m=ncontrols;
+  n=acc[i].Count();
+  y=acc[i].Mean();
+  if ((m==0) || (i>=STAT_CTRL) || (n<=m+1)) return y;
+
+  // beta=Mcc^-1.Mcy (M: co-moments)
+  for (j=0; j<m; j++) {
+    for (k=0; k<m; k++) a[j*m+k]=cov[j][STAT_CTRL+k].Comoment();
+    beta[j]=cov[j][i].Comoment();
+    d[j]=acc[STAT_CTRL+j].Mean()-ctrlmean[j];
+    e[j]=d[j];
+  }
+  if (!Solve(a,beta,m)) return y;
+  for (j=0; j<m; j++)
+    for (k=0; k<m; k++) a[j*m+k]=cov[j][STAT_CTRL+k].Comoment();
+  if (!Solve(a,e,m)) return y;
+
+  // Residual variance and variance of the adjusted mean
+  sse=acc[i].Variance()*n;
+  q=0;
+  for (j=0; j<m; j++) {
+    sse-=beta[j]*cov[j][i].Comoment();
+    q+=d[j]*e[j];
+    y-=beta[j]*d[j];
   }
-  n++;
+  if (sse<0) sse=0;
+  *hw=t(n-m-1)*sqrt(sse/(n-m-1)*(1.0/n+q));
+  return y;
+}
+
+// CLASS Resource: Returns the accumulator of statistic #i
+
+Accumulator *Resource::Acc(short i) {
+
+  if ((i>=0) && (i<NSTATS)) return &acc[i];
+  else return NULL;
+}
+
+// CLASS Resource: Writes the accumulated statistics
+// (one line per statistic, see Accumulator::Save, then one line per
+// control variate and statistic, see Covariance::Save)
+
+void Resource::SaveStats(FILE *f) {
+
+  int i, j;
+
+  for (i=0; i<NSTATS; i++) acc[i].Save(f);
+  for (j=0; j<ncontrols; j++)
+    for (i=0; i<NSTATS; i++) cov[j][i].Save(f);
+}
+
+// CLASS Resource: Adds the statistics written by SaveStats (e.g. by
+// another process or run); returns 1 if successful, 0 otherwise (the
+// statistics are then unchanged)
+
+int Resource::LoadStats(FILE *f) {
+
+  Accumulator a[NSTATS];
+  Covariance c[MAX_CONTROLS][NSTATS];
+  int i, j;
+
+  for (i=0; i<NSTATS; i++)
+    if (!a[i].Load(f)) return 0;
+  for (j=0; j<ncontrols; j++)
+    for (i=0; i<NSTATS; i++)
+      if (!c[j][i].Load(f)) return 0;
+  for (i=0; i<NSTATS; i++) acc[i].Merge(&a[i]);
+  for (j=0; j<ncontrols; j++)
+    for (i=0; i<NSTATS; i++) cov[j][i].Merge(&c[j][i]);
+  return 1;
+}
+
+// CLASS Resource: Addition of the histograms of one replication
+
+void Resource::Collect() {
+
+  allwaits.Merge(&waits);
+  allsojourns.Merge(&sojourns);
+}
+
+// CLASS Resource: Addition of the histograms of another copy of the
+// resource (e.g. in another thread)
+
+void Resource::MergeHistograms(Resource *r) {
+
+  allwaits.Merge(&r->allwaits);
+  allsojourns.Merge(&r->allsojourns);
+}
+
+// CLASS Resource: Returns the waiting times of all replications
+
+Histogram *Resource::Waits() {
+
+  return &allwaits;
+}
+
+// CLASS Resource: Returns the sojourn times of all replications
+
+Histogram *Resource::Sojourns() {
+
+  return &allsojourns;
 }
 
 // CLASS Resource: Statistics display
 
 void Resource::DisplayStats() {
 
+  static const short adjusted[8]={0,1,2,3,4,13,14,15};
+  static const char *labels[8]={"Mean response time","Mean waiting time",
+    "Mean # of clients served","Mean # of clients being served",
+    "Mean # of clients still waiting","Utilization",
+    "Mean # of clients (L)","Mean queue length (Lq)"};
+  double y, hw;
   int i;
 
   // Computation
 
-  for (i=0; i<5; i++) {
-    if (n!=0) mean[i]=stats[i]/n;
-    else mean[i]=0;
-    if (n!=0) dev[i]=(n*stats2[i]-stats[i]*stats[i])/(n*n);
-    else dev[i]=0;
-    if (dev[i]>0) dev[i]=sqrt(dev[i]);
-    else dev[i]=0;
-    if (n>1) cint[i]=t(n-1)*dev[i]/sqrt(n);
-    else cint[i]=0;
+  for (i=0; i<NSTATS; i++) {
+    mean[i]=acc[i].Mean();
+    dev[i]=sqrt(acc[i].Variance());
+    cint[i]=HalfWidth(i);
   }
 
   // Display
@@ -516,13 +2669,48 @@ void Resource::DisplayStats() {
   printf("\t* Mean # of clients served        : %10.2f\t+/- %10.2f\n",mean[2],cint[2]);
   printf("\t* Mean # of clients being served  : %10.2f\t+/- %10.2f\n",mean[3],cint[3]);
   printf("\t* Mean # of clients still waiting : %10.2f\t+/- %10.2f\n",mean[4],cint[4]);
+  printf("\t* Sojourn time p50                : %10.2f\t+/- %10.2f\n",mean[5],cint[5]);
+  printf("\t* Sojourn time p90                : %10.2f\t+/- %10.2f\n",mean[6],cint[6]);
+  printf("\t* Sojourn time p99                : %10.2f\t+/- %10.2f\n",mean[7],cint[7]);
+  printf("\t* Sojourn time max                : %10.2f\t+/- %10.2f\n",mean[8],cint[8]);
+  printf("\t* Waiting time p50                : %10.2f\t+/- %10.2f\n",mean[9],cint[9]);
+  printf("\t* Waiting time p90                : %10.2f\t+/- %10.2f\n",mean[10],cint[10]);
+  printf("\t* Waiting time p99                : %10.2f\t+/- %10.2f\n",mean[11],cint[11]);
+  printf("\t* Waiting time max                : %10.2f\t+/- %10.2f\n",mean[12],cint[12]);
+  printf("\t* Utilization                     : %10.2f\t+/- %10.2f\n",mean[13],cint[13]);
+  printf("\t* Mean # of clients (L)           : %10.2f\t+/- %10.2f\n",mean[14],cint[14]);
+  printf("\t* Mean queue length (Lq)          : %10.2f\t+/- %10.2f\n",mean[15],cint[15]);
+  if (occupancy!=NULL)
+    for (i=0; i<occupancy->States(); i++)
+      printf("\t* Time fraction in state %-2d       : %10.2f\t+/- %10.2f\n",i,
+             mean[STAT_OCC+i],cint[STAT_OCC+i]);
+  if (batchsize>0) {
+    printf("\n\tBatch means: %d batches of %d base batches%s\n",nbatches/batchsize,
+           batchsize,batchoverlap ? " (overlapping)" : "");
+    printf("\tLag-1 autocorrelation: %.2f\n",batchr1);
+    if (batchr1>1.645/sqrt((double)(nbatches/batchsize)))
+      printf("\tWarning: batch means still correlated (longer run needed)\n");
+  }
+  if (ncontrols==0) return;
+
+  // Control variates
+
+  printf("\n\tControl variates (known mean):\n\n");
+  for (i=0; i<ncontrols; i++)
+    printf("\t* %-31s : %10.2f\t+/- %10.2f\t(%.2f)\n",ctrlname[i],
+           mean[STAT_CTRL+i],cint[STAT_CTRL+i],ctrlmean[i]);
+  printf("\n\tAdjusted by the control variates:\n\n");
+  for (i=0; i<8; i++) {
+    y=Adjusted(adjusted[i],&hw);
+    printf("\t* %-31s : %10.2f\t+/- %10.2f\n",labels[i],y,hw);
+  }
 }
 
 // CLASS Resource: Returns mean value
 
 float Resource::Mean(short i) {
 
-  if ((i>=0) && (i<=4)) return mean[i];
+  if ((i>=0) && (i<NSTATS)) return mean[i];
   else return -1;
 }
 
@@ -530,64 +2718,374 @@ float Resource::Mean(short i) {
 
 float Resource::Dev(short i) {
 
-  if ((i>=0) && (i<=4)) return dev[i];
+  if ((i>=0) && (i<NSTATS)) return dev[i];
   else return -1;
 }
 
-// CLASS Resource: Insertion into queue
+// CLASS Resource: Returns resource id
+
+int Resource::Id() {
+
+  return id;
+}
 
-void Resource::EnQueue(int eventcode, Client *client, int priority) {
+// CLASS Resource: Writes the resource state (checkpoint): counters,
+// statistics of the current replication, then the queue, ring by
+// ring in FIFO order. Subclasses with their own state write it after
+// this one.
+
+void Resource::Write(FILE *f) {
+
+  QueueCell *q;
+  int i, p, present, cid;
+
+  fwrite(&ccapacity,sizeof(ccapacity),1,f);
+  fwrite(&response,sizeof(response),1,f);
+  fwrite(&wait,sizeof(wait),1,f);
+  fwrite(&nbserv,sizeof(nbserv),1,f);
+  waits.Write(f);
+  sojourns.Write(f);
+  busy.Write(f);
+  waiting.Write(f);
+  present=(occupancy!=NULL);
+  fwrite(&present,sizeof(present),1,f);
+  if (present) occupancy->Write(f);
+  fwrite(&ncontrols,sizeof(ncontrols),1,f);
+  fwrite(ctrlsum,sizeof(double),ncontrols,f);
+  fwrite(ctrln,sizeof(long),ncontrols,f);
+
+  for (p=0; p<PRIORITIES; p++) {
+    fwrite(&rings[p].count,sizeof(int),1,f);
+    for (i=0; i<rings[p].count; i++) {
+      q=rings[p].cells+((rings[p].head+i)&(rings[p].capacity-1));
+      cid=(q->client!=NULL) ? q->client->id : 0;
+      fwrite(&q->code,sizeof(q->code),1,f);
+      fwrite(&q->date,sizeof(q->date),1,f);
+      fwrite(&cid,sizeof(cid),1,f);
+    }
+  }
+}
 
-  QueueCell *prec, *cour, *nouv;
+// CLASS Resource: Reads the state written by Write() (byid[1..n]:
+// clients by id); returns 1 if successful, 0 otherwise
 
-  nouv=new QueueCell(eventcode,client,priority);
+int Resource::Read(FILE *f, Client **byid, int n) {
 
-  prec=NULL;
-  cour=bottom;
+  int ok=1, i, p, present, count, code, cid;
+  SimTime date;
 
-  while ((cour!=NULL) && (priority>cour->Priority())) {
-    prec=cour;
-    cour=cour->Previous();
+  PurgeQueue();
+  ok&=(fread(&ccapacity,sizeof(ccapacity),1,f)==1);
+  ok&=(fread(&response,sizeof(response),1,f)==1);
+  ok&=(fread(&wait,sizeof(wait),1,f)==1);
+  ok&=(fread(&nbserv,sizeof(nbserv),1,f)==1);
+  ok&=waits.Read(f);
+  ok&=sojourns.Read(f);
+  ok&=busy.Read(f);
+  ok&=waiting.Read(f);
+  ok&=(fread(&present,sizeof(present),1,f)==1);
+  if (ok && (present!=(occupancy!=NULL))) return 0;
+  if (ok && present) ok&=occupancy->Read(f);
+  ok&=(fread(&count,sizeof(count),1,f)==1);
+  if (ok && (count!=ncontrols)) return 0;
+  if (ok && (count>0)) {
+    ok&=(fread(ctrlsum,sizeof(double),count,f)==(size_t)count);
+    ok&=(fread(ctrln,sizeof(long),count,f)==(size_t)count);
   }
 
-  nouv->SetPrevious(cour);
-  nouv->SetNext(prec);
+  for (p=0; ok && (p<PRIORITIES); p++) {
+    ok&=(fread(&count,sizeof(count),1,f)==1);
+    for (i=0; ok && (i<count); i++) {
+      ok&=(fread(&code,sizeof(code),1,f)==1);
+      ok&=(fread(&date,sizeof(date),1,f)==1);
+      ok&=(fread(&cid,sizeof(cid),1,f)==1);
+      if (ok && ((cid<0) || (cid>n) || ((cid>0) && (byid[cid]==NULL)))) ok=0;
+      if (ok && ((code<0) || (code>=NEVENTS))) ok=0;
+      if (ok) EnQueue(code,(cid>0) ? byid[cid] : NULL,p,date);
+    }
+  }
+  return ok;
+}
 
-  if (prec!=NULL) prec->SetPrevious(nouv);
-  else bottom=nouv;
-  if (cour!=NULL) cour->SetNext(nouv);
-  else top=nouv;
+// CLASS Resource: Writes the statistics of past replications
+
+void Resource::WriteTotals(FILE *f) {
+
+  int i, j;
+
+  for (i=0; i<NSTATS; i++) acc[i].Write(f);
+  for (j=0; j<ncontrols; j++)
+    for (i=0; i<NSTATS; i++) cov[j][i].Write(f);
+  allwaits.Write(f);
+  allsojourns.Write(f);
 }
 
-// CLASS Resource: Returns the code of the 1st event in queue 
+// CLASS Resource: Reads the statistics written by WriteTotals()
+// (returns 1 if successful)
 
-int Resource::GetEventCode() {
+int Resource::ReadTotals(FILE *f) {
 
-  if (top!=NULL) return top->Code();
-  else return -1;
+  int ok=1, i, j;
+
+  for (i=0; ok && (i<NSTATS); i++) ok&=acc[i].Read(f);
+  for (j=0; ok && (j<ncontrols); j++)
+    for (i=0; ok && (i<NSTATS); i++) ok&=cov[j][i].Read(f);
+  if (ok) ok&=allwaits.Read(f);
+  if (ok) ok&=allsojourns.Read(f);
+  return ok;
 }
 
-// CLASS Resource: Returns pointer toward 1st client in queue
+// CLASS Resource: Deletes the statistics of the replication gathered
+// so far (end of warm-up): clients in the system count from Tnow,
+// time averages restart at Tnow in the current state
 
-Client *Resource::GetClient() {
+void Resource::Truncate() {
 
-  if (top!=NULL) return top->Cli();
-  else return NULL;
+  int nbwait, nbbs, i;
+
+  if (ccapacity<0) {
+    nbwait=-ccapacity;
+    nbbs=capacity;
+  } else {
+    nbwait=0;
+    nbbs=capacity-ccapacity;
+  }
+  response=-nbbs*Units(simul->Tnow());
+  wait=-nbwait*Units(simul->Tnow());
+  nbserv=0;
+  waits.Reset();
+  sojourns.Reset();
+  busy.Reset(Units(simul->Tnow()),busy.Value());
+  waiting.Reset(Units(simul->Tnow()),waiting.Value());
+  if (occupancy!=NULL) occupancy->Reset(Units(simul->Tnow()),occupancy->State());
+  for (i=0; i<ncontrols; i++) {
+    ctrlsum[i]=0;
+    ctrln[i]=0;
+  }
 }
 
-// CLASS Resource: Deletes queue top
+// CLASS Resource: Closes a base batch of a batch means run: its
+// statistics are kept (see BatchMeans) and its histograms added
 
-void Resource::DestroyTop() {
+void Resource::Batch() {
 
-  QueueCell *save;
+  double *b;
+  long *bs;
 
-  if (top!=NULL) {
-    save=top;
-    top=top->Next();
-    if  (top!=NULL) top->SetPrevious(NULL);
-    else bottom=NULL;
-    delete save;
+  if (nbatches==batchcap) {
+    batchcap=(batchcap>0) ? 2*batchcap : BATCH_BASE;
+    b=new double[batchcap*NSTATS];
+    if (nbatches>0) memcpy(b,batches,nbatches*NSTATS*sizeof(double));
+    delete[] batches;
+    batches=b;
+    bs=new long[2*batchcap+1];
+    if (nbatches>0) memcpy(bs,binstart,(2*nbatches+1)*sizeof(long));
+    delete[] binstart;
+    binstart=bs;
+  }
+  Sample(batches+nbatches*NSTATS);
+  binstart[2*nbatches]=nbins;
+  SaveBins(&sojourns);
+  binstart[2*nbatches+1]=nbins;
+  SaveBins(&waits);
+  binstart[2*nbatches+2]=nbins;
+  nbatches++;
+  Collect();
+}
+
+// CLASS Resource: Appends the non-empty buckets of h to the base
+// batches' buckets (a base batch holds at most one bucket per client)
+
+void Resource::SaveBins(Histogram *h) {
+
+  int *bi;
+  long *bc;
+  int n=h->Bins();
+
+  if (nbins+n>bincap) {
+    while (nbins+n>bincap) bincap=(bincap>0) ? 2*bincap : 4096;
+    bi=new int[bincap];
+    bc=new long[bincap];
+    if (nbins>0) {
+      memcpy(bi,binindex,nbins*sizeof(int));
+      memcpy(bc,bincount,nbins*sizeof(long));
+    }
+    delete[] binindex;
+    delete[] bincount;
+    binindex=bi;
+    bincount=bc;
+  }
+  h->GetBins(binindex+nbins,bincount+nbins);
+  nbins+=n;
+}
+
+// CLASS Resource: Sojourn and waiting time quantiles and maxima
+// (statistics 5-12) of the batch made of base batches b..b+k-1, from
+// their merged histograms (h: work histogram)
+
+void Resource::BatchQuantiles(int b, int k, Histogram *h, double s[NSTATS]) {
+
+  long first;
+  int w, l;
+
+  for (w=0; w<2; w++) {                 // Sojourns (5-8), then waits (9-12)
+    h->Reset();
+    for (l=b; l<b+k; l++) {
+      first=binstart[2*l+w];
+      h->AddBins(binindex+first,bincount+first,(int)(binstart[2*l+w+1]-first),
+                 batches[l*NSTATS+8+4*w]);
+    }
+    s[5+4*w]=h->Quantile(0.5);
+    s[6+4*w]=h->Quantile(0.9);
+    s[7+4*w]=h->Quantile(0.99);
+    s[8+4*w]=h->Max();
+  }
+}
+
+// CLASS Resource: Lag-1 autocorrelation of the means of batches of k
+// base batches (the most correlated of the mean times and levels)
+
+double Resource::Correlation(int k) {
+
+  static const short checked[5]={0,1,13,14,15};
+  double *y, m, num, den, r, rmax;
+  int nb, first, c, i, j, l;
+
+  nb=nbatches/k;
+  if (nb<2) return 0;
+  first=nbatches-nb*k;
+  y=new double[nb];
+  rmax=-1;
+  for (c=0; c<5; c++) {
+    i=checked[c];
+    m=0;
+    for (j=0; j<nb; j++) {
+      y[j]=0;
+      for (l=0; l<k; l++) y[j]+=batches[(first+j*k+l)*NSTATS+i];
+      y[j]/=k;
+      m+=y[j];
+    }
+    m/=nb;
+    num=0;
+    den=0;
+    for (j=0; j<nb; j++) {
+      den+=(y[j]-m)*(y[j]-m);
+      if (j>0) num+=(y[j]-m)*(y[j-1]-m);
+    }
+    r=(den>0) ? num/den : 0;
+    if (r>rmax) rmax=r;
+  }
+  delete[] y;
+  return rmax;
+}
+
+// CLASS Resource: Statistics of a batch means run: batches of
+// batchsize base batches (the first nbatches%batchsize are dropped),
+// the size doubling while their lag-1 autocorrelation is significant
+// (one-sided 0.05 test) and there would be at least BATCH_MIN of them.
+// The batch means are accumulated as replications. Quantiles and
+// maxima are those of each batch's merged histograms (not means of
+// base batch quantiles, which would depend on the base batch size);
+// their intervals are always from non-overlapping batches.
+
+void Resource::BatchMeans(int overlap) {
+
+  Histogram h;
+  double s[NSTATS];
+  int k, nb, first, i, j, l;
+
+  k=1;
+  while ((nbatches/k>=2*BATCH_MIN) &&
+         (Correlation(k)>1.645/sqrt((double)(nbatches/k)))) k*=2;
+  batchsize=k;
+  batchoverlap=overlap;
+  nb=nbatches/k;
+  if (nb<2) return;
+  batchr1=Correlation(k);
+  first=nbatches-nb*k;
+  for (j=0; j<nb; j++) {
+    for (i=0; i<NSTATS; i++) {
+      s[i]=0;
+      for (l=0; l<k; l++) s[i]+=batches[(first+j*k+l)*NSTATS+i];
+      s[i]/=k;
+    }
+    BatchQuantiles(first+j*k,k,&h,s);
+    Accumulate(s);
+  }
+}
+
+// CLASS Resource: 0.95 confidence interval half-width of statistic #i
+// from the overlapping batch means of batchsize base batches
+// (Meketon & Schmeiser; 1.5(n/k-1) degrees of freedom)
+
+double Resource::OverlapHalfWidth(short i) {
+
+  double o, ss, var, x;
+  int n, k, first, j;
+
+  k=batchsize;
+  n=(nbatches/k)*k;
+  first=nbatches-n;
+  x=acc[i].Mean();
+  o=0;
+  for (j=0; j<k; j++) o+=batches[(first+j)*NSTATS+i];
+  ss=(o/k-x)*(o/k-x);
+  for (j=k; j<n; j++) {
+    o+=batches[(first+j)*NSTATS+i]-batches[(first+j-k)*NSTATS+i];
+    ss+=(o/k-x)*(o/k-x);
+  }
+  var=k*ss/((double)(n-k+1)*(n-k));
+  return t((int)(1.5*(n/k-1)))*sqrt(var);
+}
+
+// CLASS Resource: Insertion into queue
+// Priorities 0..PRIORITIES-1 (others are clamped), the highest first;
+// clients of equal priority are served in FIFO order. O(1), except
+// when a ring grows (rings are kept from one replication to the next).
+
+void Resource::EnQueue(int eventcode, Client *client, int priority, SimTime date) {
+
+  PriorityRing *r;
+  QueueCell *larger, *nouv;
+  int i;
+
+  if (priority<0) priority=0;
+  if (priority>=PRIORITIES) priority=PRIORITIES-1;
+  r=rings+priority;
+
+  if (r->count==r->capacity) {          // Ring full: doubles
+    larger=new QueueCell[(r->capacity>0) ? 2*r->capacity : 16];
+    for (i=0; i<r->count; i++) larger[i]=r->cells[(r->head+i)&(r->capacity-1)];
+    delete[] r->cells;
+    r->cells=larger;
+    r->head=0;
+    r->capacity=(r->capacity>0) ? 2*r->capacity : 16;
   }
+
+  nouv=r->cells+((r->head+r->count)&(r->capacity-1));
+  nouv->code=eventcode;
+  nouv->date=date;
+  nouv->client=client;
+  r->count++;
+  levels|=(uint64_t)1<<priority;
+}
+
+// CLASS Resource: Removes the 1st element in queue and copies it to
+// *cell (returns 1, or 0 if the queue is empty)
+
+int Resource::DeQueue(QueueCell *cell) {
+
+  PriorityRing *r;
+  int priority;
+
+  if (levels==0) return 0;
+  priority=63-__builtin_clzll(levels);  // Highest non-empty priority
+  r=rings+priority;
+
+  *cell=r->cells[r->head];
+  r->head=(r->head+1)&(r->capacity-1);
+  if (--r->count==0) levels&=~((uint64_t)1<<priority);
+  return 1;
 }
 
 // CLASS Resource: Returns queue status
@@ -595,70 +3093,301 @@ void Resource::DestroyTop() {
 
 int Resource::QueueEmpty() {
 
-  if (top==NULL) return 1;
+  if (levels==0) return 1;
   else return 0;
 }
 
 /////////////////////////////////////////////////////////////////////
-// CLASS QueueCell
+// CLASS Sweep
 /////////////////////////////////////////////////////////////////////
 
-// CLASS QueueCell: Constructor
+// CLASS Sweep: Constructor (the threads' simulations copy the times,
+// seed, future event list, generator and warm-up period of sim)
+
+Sweep::Sweep(Simulation *sim, int npoints, SweepSetup setup, void *data) {
+
+  base=sim;
+  this->npoints=(npoints>0) ? npoints : 1;
+  this->setup=setup;
+  this->data=data;
+  noutputs=0;
+  nreplic=0;
+  antithetic=0;
+  nthreads=0;
+  ranges=NULL;
+  nsteals=0;
+  samples=NULL;
+  acc=NULL;
+}
 
-QueueCell::QueueCell(int code, Client *cli, int prior) {
+// CLASS Sweep: Destructor
 
-  eventcode=code;
-  client=cli;
-  priority=prior;
-  next=NULL;
-  previous=NULL;
+Sweep::~Sweep() {
+
+  delete[] ranges;
+  delete[] samples;
+  delete[] acc;
 }
 
-// CLASS QueueCell: Returns event code
+// CLASS Sweep: New output column: statistic #stat of resource #res
+// (see Resource). Returns 1 if successful, 0 if there are too many
+// columns or the statistic does not exist.
 
-int QueueCell::Code() {
+int Sweep::AddOutput(int res, short stat, const char *label) {
 
-  return eventcode;
+  if ((noutputs==MAX_OUTPUTS) || (stat<0) || (stat>=NSTATS)) return 0;
+  outputs[noutputs].resource=res;
+  outputs[noutputs].stat=stat;
+  strncpy(outputs[noutputs].label,label,STRS-1);
+  outputs[noutputs].label[STRS-1]='\0';
+  noutputs++;
+  return 1;
 }
 
-// CLASS QueueCell: Returns pointer toward client
+// CLASS Sweep: Runs nreplic replications of each point on nthreads
+// threads (anti: in antithetic pairs, nreplic being then rounded up to
+// an even number)
+
+void Sweep::Run(int nreplic, int nthreads, int anti) {
+
+  std::thread **threads;
+  long ntasks;
+  int i, p, c, j;
+
+  if (nreplic<1) nreplic=1;
+  if (nthreads<1) nthreads=1;
+  if (anti && (nreplic%2)) nreplic++;
+  antithetic=anti;
+  this->nreplic=nreplic;
+  this->nthreads=nthreads;
+  ntasks=(long)npoints*nreplic;
+
+  delete[] ranges;
+  delete[] samples;
+  delete[] acc;
+  ranges=new SweepRange[nthreads];
+  samples=new double[ntasks*(noutputs>0 ? noutputs : 1)];
+  acc=new Accumulator[npoints*(noutputs>0 ? noutputs : 1)];
+  nsteals=0;
+
+  // Tasks dealt in contiguous ranges (point-major order)
+  for (i=0; i<nthreads; i++) {
+    ranges[i].lo=ntasks*i/nthreads;
+    ranges[i].hi=ntasks*(i+1)/nthreads;
+  }
 
-Client *QueueCell::Cli() {
+  LogInfo("\nSweep started (%d points, %d threads)... ",npoints,nthreads);
+  threads=new std::thread*[nthreads];
+  for (i=0; i<nthreads; i++) threads[i]=new std::thread(&Sweep::Worker,this,i);
+  for (i=0; i<nthreads; i++) {
+    threads[i]->join();
+    delete threads[i];
+  }
+  delete[] threads;
+  LogInfo("End of sweep (%ld steals)\n",Steals());
 
-  return client;
+  // Statistics merging (replication order)
+  for (p=0; p<npoints; p++)
+    for (j=0; j<(antithetic ? nreplic/2 : nreplic); j++)
+      for (c=0; c<noutputs; c++) acc[p*noutputs+c].Add(Observation(p,j,c));
 }
 
-// CLASS QueueCell: Returns event priority
+// CLASS Sweep: Returns observation j of column col at point: output of
+// replication j, or average of antithetic pair j
+
+double Sweep::Observation(int point, int j, int col) {
 
-int QueueCell::Priority() {
+  long t;
 
-  return priority;
+  if (antithetic) {
+    t=(long)point*nreplic+2*j;
+    return (samples[t*noutputs+col]+samples[(t+1)*noutputs+col])/2;
+  } else {
+    t=(long)point*nreplic+j;
+    return samples[t*noutputs+col];
+  }
 }
 
-// CLASS QueueCell: Returns pointer toward next cell
+// CLASS Sweep: Thread body: runs tasks on a private simulation, set
+// up again only when the point changes
 
-QueueCell *QueueCell::Next() {
+void Sweep::Worker(int w) {
 
-  return next;
+  Simulation *sim;
+  Resource *res;
+  double s[NSTATS];
+  long task;
+  int point, current, c;
+
+  sim=new Simulation(base->tstart,base->tmax,base->rseed,base->felkind,base->genkind);
+  sim->SetWarmup(base->warmup);
+  sim->SetDispatch(base->dispatch);
+  current=-1;
+
+  while (Next(w,&task)) {
+    point=task/nreplic;
+    if (point!=current) {
+      setup(sim,point,data);
+      current=point;
+    }
+    if (antithetic) sim->Substream((task%nreplic)/2,(task%nreplic)%2);
+    else sim->Substream(task%nreplic,0);
+    sim->Replicate();
+    for (c=0; c<noutputs; c++) {
+      res=sim->GetResource(outputs[c].resource);
+      if (res!=NULL) {
+        res->Sample(s);
+        samples[task*noutputs+c]=s[outputs[c].stat];
+      } else samples[task*noutputs+c]=0;
+    }
+    sim->PurgeClientList();
+  }
+
+  delete sim;
 }
 
-// CLASS QueueCell: Returns pointer toward previous cell
+// CLASS Sweep: Takes the next task of thread w, or steals the second
+// half of the largest range left to another thread
+// Returns 1 if a task was found, 0 if all tasks are taken.
 
-QueueCell *QueueCell::Previous() {
+int Sweep::Next(int w, long *task) {
 
-  return previous;
+  SweepRange *own, *victim;
+  long lo, hi, n, best;
+  int i;
+
+  own=ranges+w;
+  own->lock.lock();
+  if (own->lo<own->hi) {
+    *task=own->lo++;
+    own->lock.unlock();
+    return 1;
+  }
+  own->lock.unlock();
+
+  while (1) {
+    victim=NULL;
+    best=0;
+    for (i=0; i<nthreads; i++) {
+      if (i==w) continue;
+      ranges[i].lock.lock();
+      n=ranges[i].hi-ranges[i].lo;
+      ranges[i].lock.unlock();
+      if (n>best) {
+        best=n;
+        victim=ranges+i;
+      }
+    }
+    if (victim==NULL) return 0;
+
+    victim->lock.lock();
+    lo=victim->lo+(victim->hi-victim->lo)/2;
+    hi=victim->hi;
+    victim->hi=lo;
+    victim->lock.unlock();
+
+    if (lo<hi) {                         // Else taken meanwhile: retry
+      nsteals++;
+      own->lock.lock();
+      *task=lo;
+      own->lo=lo+1;
+      own->hi=hi;
+      own->lock.unlock();
+      return 1;
+    }
+  }
 }
 
-// CLASS QueueCell: Reinitializes pointer toward next cell
+// CLASS Sweep: Returns the mean of output column col at point
 
-void QueueCell::SetNext(QueueCell *newnext) {
+double Sweep::Mean(int point, int col) {
 
-  next=newnext;
+  if ((acc==NULL) || (point<0) || (point>=npoints) || (col<0) || (col>=noutputs))
+    return 0;
+  return acc[point*noutputs+col].Mean();
 }
 
-// CLASS QueueCell: Reinitializes pointer toward previous cell
+// CLASS Sweep: Returns the 0.95 confidence interval half-width of
+// output column col at point (0 if less than 2 replications)
 
-void QueueCell::SetPrevious(QueueCell *newprev) {
+double Sweep::HalfWidth(int point, int col) {
 
-  previous=newprev;
+  long n;
+
+  if ((acc==NULL) || (point<0) || (point>=npoints) || (col<0) || (col>=noutputs))
+    return 0;
+  n=acc[point*noutputs+col].Count();
+  if (n>1) return t(n-1)*sqrt(acc[point*noutputs+col].Variance())/sqrt(n);
+  else return 0;
+}
+
+// CLASS Sweep: Returns the mean of the paired differences (point minus
+// ref, observation by observation) of column col, and the 0.95
+// confidence interval half-width of this mean in *halfwidth. With
+// common random numbers, it is much narrower than the half-widths of
+// both means.
+
+double Sweep::Difference(int point, int ref, int col, double *halfwidth) {
+
+  Accumulator d;
+  int j;
+
+  *halfwidth=0;
+  if ((acc==NULL) || (point<0) || (point>=npoints) || (ref<0) || (ref>=npoints) ||
+      (col<0) || (col>=noutputs))
+    return 0;
+  for (j=0; j<(antithetic ? nreplic/2 : nreplic); j++)
+    d.Add(Observation(point,j,col)-Observation(ref,j,col));
+  if (d.Count()>1) *halfwidth=t(d.Count()-1)*sqrt(d.Variance())/sqrt(d.Count());
+  return d.Mean();
+}
+
+// CLASS Sweep: Returns the number of successful steals of the last run
+
+long Sweep::Steals() {
+
+  return nsteals;
+}
+
+// CLASS Sweep: Writes one CSV row per point: the columns written by
+// label (named in header), then the mean and half-width of each
+// output column
+
+void Sweep::Write(FILE *f, const char *header, SweepLabel label) {
+
+  int p, c;
+
+  fprintf(f,"%s",header);
+  for (c=0; c<noutputs; c++)
+    fprintf(f,",%s,%s_hw",outputs[c].label,outputs[c].label);
+  fprintf(f,"\n");
+  for (p=0; p<npoints; p++) {
+    label(f,p,data);
+    for (c=0; c<noutputs; c++) fprintf(f,",%g,%g",Mean(p,c),HalfWidth(p,c));
+    fprintf(f,"\n");
+  }
+}
+
+// CLASS Sweep: Writes one CSV row per point other than ref: the columns
+// written by label (named in header), then the paired difference with
+// ref and its half-width for each output column
+
+void Sweep::WriteDifferences(FILE *f, int ref, const char *header, SweepLabel label) {
+
+  double d, hw;
+  int p, c;
+
+  fprintf(f,"%s",header);
+  for (c=0; c<noutputs; c++)
+    fprintf(f,",d_%s,d_%s_hw",outputs[c].label,outputs[c].label);
+  fprintf(f,"\n");
+  for (p=0; p<npoints; p++) {
+    if (p==ref) continue;
+    label(f,p,data);
+    for (c=0; c<noutputs; c++) {
+      d=Difference(p,ref,c,&hw);
+      fprintf(f,",%g,%g",d,hw);
+    }
+    fprintf(f,"\n");
+  }
 }
@@ -8,35 +8,40 @@
 // simutil.h: Utilitary functions
 // Invariable
 /////////////////////////////////////////////////////////////////////
-// Random variables computation (float/int)
+// Random variables computation (SimReal/int, see simtime.h), drawn
+// from generator rg
 //
-// - Poisson law:       float Poisson(float lambda);
-//                      int IPoisson(float lambda);
-// - Exponential law:   float Exp(float avg);
-//                      int IExp(int avg);
-// - Uniform law:       float Uni(float min, float max);
-//                      int IUni(int min, int max);
+// - Poisson law:       SimReal Poisson(RandomStream *rg, SimReal lambda);
+//                      int IPoisson(RandomStream *rg, float lambda);
+// - Exponential law:   SimReal Exp(RandomStream *rg, SimReal avg);
+//                      int IExp(RandomStream *rg, int avg);
+// - Uniform law:       SimReal Uni(RandomStream *rg, SimReal min, SimReal max);
+//                      int IUni(RandomStream *rg, int min, int max);
+// Buffered and vectorized variates: see simvar.h
 /////////////////////////////////////////////////////////////////////
 // Student t-distribution function: float t(int n);
 /////////////////////////////////////////////////////////////////////
 // Computation - number of digits in an integer: int digit(int n);
 /////////////////////////////////////////////////////////////////////
 
-#include "lewis.h"
+#include "simlog.h"
+#include "simtime.h"
+#include "simrng.h"
+#include "simvar.h"
 
 /////////////////////////////////////////////////////////////////////
 // Poisson law
 /////////////////////////////////////////////////////////////////////
 
-float Poisson(float lambda) {
+SimReal Poisson(RandomStream *rg, SimReal lambda) {
 
-  float res=-log(1-randu(lp_tt))/lambda;
+  SimReal res=-log(1-rg->Randu())/lambda;
   return res;
 }
 
-int IPoisson(float lambda) {
+int IPoisson(RandomStream *rg, float lambda) {
 
-  int res=(int)(-log(1-randu(lp_tt))/lambda);
+  int res=(int)(-log(1-rg->Randu())/lambda);
   return res;
 }
 
@@ -44,15 +49,15 @@ int IPoisson(float lambda) {
 // Exponential law
 /////////////////////////////////////////////////////////////////////
 
-float Exp(float avg) {
+SimReal Exp(RandomStream *rg, SimReal avg) {
 
-  float res=-log(1-randu(lp_tt))*avg;
+  SimReal res=-log(1-rg->Randu())*avg;
   return res;
 }
 
-int IExp(int avg) {
+int IExp(RandomStream *rg, int avg) {
 
-  int res=(int)(-log(1-randu(lp_tt))*avg);
+  int res=(int)(-log(1-rg->Randu())*avg);
   return res;
 }
 
@@ -60,15 +65,15 @@ int IExp(int avg) {
 // Uniform law
 /////////////////////////////////////////////////////////////////////
 
-float Uni(float min, float max) {
+SimReal Uni(RandomStream *rg, SimReal min, SimReal max) {
 
-  float res=min+(max-min)*randu(lp_tt);
+  SimReal res=min+(max-min)*rg->Randu();
   return res;
 }
 
-int IUni(int min, int max) {
+int IUni(RandomStream *rg, int min, int max) {
 
-  int res=(int)(min+(max-min+1)*randu(lp_tt));
+  int res=(int)(min+(max-min+1)*rg->Randu());
   return res;
 }
 
@@ -0,0 +1,531 @@
+/////////////////////////////////////////////////////////////////////
+// DESP-C++ (Discrete-Event Simulation Package)
+/////////////////////////////////////////////////////////////////////
+// simvar.h: Buffered random variates
+// Invariable
+/////////////////////////////////////////////////////////////////////
+// A VariateStream draws uniforms from a RandomStream by blocks of
+// VARBUF and turns them into variates:
+//
+// - one at a time:     Exp(avg), Uni(min,max), Poisson(lambda)
+// - n at a time:       ExpBlock(), UniBlock(), PoissonBlock()
+//
+// The k-th uniform consumed is always the k-th draw of the stream,
+// whatever the mix of scalar and block calls. Simulation::Variates(k)
+// gives the buffered variates of random stream #k; a stream must then
+// not be drawn directly as well (buffered uniforms would be skipped).
+//
+// Transforms are computed in double precision, with one logarithm
+// kernel (fdlibm polynomial, fused multiply-adds) in scalar, AVX2 and
+// AVX-512 versions that give bit-identical results: the values do not
+// depend on the machine. They may differ from the functions of
+// simutil.h in the last bit (those use the C library logarithm).
+// Scalar variates are SimReal's (see simtime.h), blocks are doubles.
+//
+// The scalar calls also use the vector kernels: once a law (say
+// Exp(10)) is drawn twice within one block, the rest of the block is
+// transformed at once for it. Two laws are cached per block, so a
+// stream shared by two laws (e.g. arrivals and services) stays
+// vectorized.
+//
+// The kernel is chosen from the processor's features before main()
+// (VariateKernel()); SetVariateKernel() forces a slower one.
+/////////////////////////////////////////////////////////////////////
+
+// Includes
+
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VAR_X86 1
+#include <immintrin.h>
+#endif
+
+/////////////////////////////////////////////////////////////////////
+// Constants
+/////////////////////////////////////////////////////////////////////
+
+#define VARBUF 256            // Uniforms per block
+#define VAR_LAWS 2            // Laws transformed per block
+
+// Transform kernels (see VariateKernel)
+
+#define VAR_SCALAR 0          // Portable loop
+#define VAR_AVX2 1            // AVX2 and FMA, 4 doubles
+#define VAR_AVX512 2          // AVX-512F, 8 doubles
+
+// Natural logarithm kernel constants (fdlibm)
+
+#define LOG_LN2HI 6.93147180369123816490e-01
+#define LOG_LN2LO 1.90821492927058770002e-10
+#define LOG_SQRT2 1.41421356237309504880
+#define LOG_LG1 6.666666666666735130e-01
+#define LOG_LG2 3.999999999940941908e-01
+#define LOG_LG3 2.857142874366239149e-01
+#define LOG_LG4 2.222219843214978396e-01
+#define LOG_LG5 1.818357216161805012e-01
+#define LOG_LG6 1.531383769920937332e-01
+#define LOG_LG7 1.479819860511658591e-01
+
+/////////////////////////////////////////////////////////////////////
+// Kernel selection
+/////////////////////////////////////////////////////////////////////
+
+// Returns the best kernel the processor supports
+
+int BestVariateKernel() {
+
+#ifdef VAR_X86
+  __builtin_cpu_init();                 // May run before its own constructor
+  if (__builtin_cpu_supports("avx512f")) return VAR_AVX512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return VAR_AVX2;
+#endif
+  return VAR_SCALAR;
+}
+
+// Kernel in use, chosen before main() (threads only read it)
+
+int var_kernel=BestVariateKernel();
+
+// Returns the kernel in use
+
+int VariateKernel() {
+
+  return var_kernel;
+}
+
+// Forces kernel k (VAR_*), if the processor supports it; returns the
+// kernel in use. Not to be called while simulation threads run.
+
+int SetVariateKernel(int k) {
+
+  int best=BestVariateKernel();
+
+  if ((k<VAR_SCALAR) || (k>best)) k=best;
+  var_kernel=k;
+  return var_kernel;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Transform kernels: out[i]=a+b*u[i] (linear) or out[i]=-b*log(1-u[i])
+// (logarithm, u in [0,1)). Vector kernels return the number of values
+// done (a multiple of their width); the scalar loop does the rest.
+/////////////////////////////////////////////////////////////////////
+
+// log(x) for x in [2^-53,1] (no special cases): the operations of
+// Log4 and Log8, one value at a time
+
+double Log1(double x) {
+
+  double e, m, f, s, z, w, r1, r2, hfsq, res;
+  int ex;
+
+  m=2*frexp(x,&ex);                     // m in [1,2)
+  e=ex-1;
+  if (m>LOG_SQRT2) {
+    m*=0.5;
+    e+=1.0;
+  }
+
+  f=m-1.0;
+  s=f/(f+2.0);
+  z=s*s;
+  w=z*z;
+  r1=fma(w,LOG_LG7,LOG_LG5);
+  r1=fma(w,r1,LOG_LG3);
+  r1=fma(w,r1,LOG_LG1);
+  r1=z*r1;
+  r2=fma(w,LOG_LG6,LOG_LG4);
+  r2=fma(w,r2,LOG_LG2);
+  r1=fma(w,r2,r1);
+  hfsq=0.5*(f*f);
+  res=fma(s,hfsq+r1,e*LOG_LN2LO);
+  res=f-(hfsq-res);
+
+  return fma(e,LOG_LN2HI,res);
+}
+
+#ifdef VAR_X86
+
+// log(x) for 8 doubles in [2^-53,1] (no special cases)
+
+__attribute__((target("avx512f")))
+__m512d Log8(__m512d x) {
+
+  __m512d e, m, f, s, z, w, r1, r2, hfsq, res;
+  __mmask8 big;
+
+  // Masked forms: the unmasked ones trip -Wuninitialized in gcc 12
+  e=_mm512_mask_getexp_pd(x,(__mmask8)-1,x);
+  m=_mm512_mask_getmant_pd(x,(__mmask8)-1,x,_MM_MANT_NORM_1_2,_MM_MANT_SIGN_src);
+  big=_mm512_cmp_pd_mask(m,_mm512_set1_pd(LOG_SQRT2),_CMP_GT_OQ);
+  m=_mm512_mask_mul_pd(m,big,m,_mm512_set1_pd(0.5));
+  e=_mm512_mask_add_pd(e,big,e,_mm512_set1_pd(1.0));
+
+  f=_mm512_sub_pd(m,_mm512_set1_pd(1.0));
+  s=_mm512_div_pd(f,_mm512_add_pd(f,_mm512_set1_pd(2.0)));
+  z=_mm512_mul_pd(s,s);
+  w=_mm512_mul_pd(z,z);
+  r1=_mm512_fmadd_pd(w,_mm512_set1_pd(LOG_LG7),_mm512_set1_pd(LOG_LG5));
+  r1=_mm512_fmadd_pd(w,r1,_mm512_set1_pd(LOG_LG3));
+  r1=_mm512_fmadd_pd(w,r1,_mm512_set1_pd(LOG_LG1));
+  r1=_mm512_mul_pd(z,r1);
+  r2=_mm512_fmadd_pd(w,_mm512_set1_pd(LOG_LG6),_mm512_set1_pd(LOG_LG4));
+  r2=_mm512_fmadd_pd(w,r2,_mm512_set1_pd(LOG_LG2));
+  r1=_mm512_fmadd_pd(w,r2,r1);
+  hfsq=_mm512_mul_pd(_mm512_set1_pd(0.5),_mm512_mul_pd(f,f));
+  res=_mm512_fmadd_pd(s,_mm512_add_pd(hfsq,r1),_mm512_mul_pd(e,_mm512_set1_pd(LOG_LN2LO)));
+  res=_mm512_sub_pd(f,_mm512_sub_pd(hfsq,res));
+
+  return _mm512_fmadd_pd(e,_mm512_set1_pd(LOG_LN2HI),res);
+}
+
+// log(x) for 4 doubles in [2^-53,1] (no special cases)
+
+__attribute__((target("avx2,fma")))
+__m256d Log4(__m256d x) {
+
+  __m256i bits, ebits;
+  __m256d e, m, f, s, z, w, r1, r2, hfsq, res, big;
+  const __m256d two52=_mm256_set1_pd(4503599627370496.0);
+
+  bits=_mm256_castpd_si256(x);
+
+  // Exponent (biased field to double through the 2^52 trick)
+  ebits=_mm256_srli_epi64(bits,52);
+  e=_mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(ebits,_mm256_castpd_si256(two52))),two52);
+  e=_mm256_sub_pd(e,_mm256_set1_pd(1023.0));
+
+  // Mantissa in [1,2), then in [sqrt(2)/2,sqrt(2))
+  m=_mm256_castsi256_pd(_mm256_or_si256(
+      _mm256_and_si256(bits,_mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL)),
+      _mm256_set1_epi64x(0x3FF0000000000000LL)));
+  big=_mm256_cmp_pd(m,_mm256_set1_pd(LOG_SQRT2),_CMP_GT_OQ);
+  m=_mm256_blendv_pd(m,_mm256_mul_pd(m,_mm256_set1_pd(0.5)),big);
+  e=_mm256_add_pd(e,_mm256_and_pd(big,_mm256_set1_pd(1.0)));
+
+  f=_mm256_sub_pd(m,_mm256_set1_pd(1.0));
+  s=_mm256_div_pd(f,_mm256_add_pd(f,_mm256_set1_pd(2.0)));
+  z=_mm256_mul_pd(s,s);
+  w=_mm256_mul_pd(z,z);
+  r1=_mm256_fmadd_pd(w,_mm256_set1_pd(LOG_LG7),_mm256_set1_pd(LOG_LG5));
+  r1=_mm256_fmadd_pd(w,r1,_mm256_set1_pd(LOG_LG3));
+  r1=_mm256_fmadd_pd(w,r1,_mm256_set1_pd(LOG_LG1));
+  r1=_mm256_mul_pd(z,r1);
+  r2=_mm256_fmadd_pd(w,_mm256_set1_pd(LOG_LG6),_mm256_set1_pd(LOG_LG4));
+  r2=_mm256_fmadd_pd(w,r2,_mm256_set1_pd(LOG_LG2));
+  r1=_mm256_fmadd_pd(w,r2,r1);
+  hfsq=_mm256_mul_pd(_mm256_set1_pd(0.5),_mm256_mul_pd(f,f));
+  res=_mm256_fmadd_pd(s,_mm256_add_pd(hfsq,r1),_mm256_mul_pd(e,_mm256_set1_pd(LOG_LN2LO)));
+  res=_mm256_sub_pd(f,_mm256_sub_pd(hfsq,res));
+
+  return _mm256_fmadd_pd(e,_mm256_set1_pd(LOG_LN2HI),res);
+}
+
+__attribute__((target("avx512f")))
+int LinearAvx512(const double *u, double a, double b, double *out, int n) {
+
+  int i;
+
+  for (i=0; i+8<=n; i+=8)
+    _mm512_storeu_pd(out+i,_mm512_fmadd_pd(_mm512_set1_pd(b),_mm512_loadu_pd(u+i),
+                     _mm512_set1_pd(a)));
+  return i;
+}
+
+__attribute__((target("avx2,fma")))
+int LinearAvx2(const double *u, double a, double b, double *out, int n) {
+
+  int i;
+
+  for (i=0; i+4<=n; i+=4)
+    _mm256_storeu_pd(out+i,_mm256_fmadd_pd(_mm256_set1_pd(b),_mm256_loadu_pd(u+i),
+                     _mm256_set1_pd(a)));
+  return i;
+}
+
+__attribute__((target("avx512f")))
+int LogAvx512(const double *u, double b, double *out, int n) {
+
+  __m512d one=_mm512_set1_pd(1.0), mb=_mm512_set1_pd(-b);
+  int i;
+
+  for (i=0; i+8<=n; i+=8)
+    _mm512_storeu_pd(out+i,_mm512_mul_pd(mb,Log8(_mm512_sub_pd(one,_mm512_loadu_pd(u+i)))));
+  return i;
+}
+
+__attribute__((target("avx2,fma")))
+int LogAvx2(const double *u, double b, double *out, int n) {
+
+  __m256d one=_mm256_set1_pd(1.0), mb=_mm256_set1_pd(-b);
+  int i;
+
+  for (i=0; i+4<=n; i+=4)
+    _mm256_storeu_pd(out+i,_mm256_mul_pd(mb,Log4(_mm256_sub_pd(one,_mm256_loadu_pd(u+i)))));
+  return i;
+}
+
+#endif
+
+// out[i]=a+b*u[i]
+
+void LinearKernel(const double *u, double a, double b, double *out, int n) {
+
+  int i=0;
+
+#ifdef VAR_X86
+  switch (VariateKernel()) {
+  case VAR_AVX512: i=LinearAvx512(u,a,b,out,n); break;
+  case VAR_AVX2:   i=LinearAvx2(u,a,b,out,n); break;
+  }
+#endif
+  for (; i<n; i++) out[i]=fma(b,u[i],a);
+}
+
+// out[i]=-b*log(1-u[i])
+
+void LogKernel(const double *u, double b, double *out, int n) {
+
+  int i=0;
+
+#ifdef VAR_X86
+  switch (VariateKernel()) {
+  case VAR_AVX512: i=LogAvx512(u,b,out,n); break;
+  case VAR_AVX2:   i=LogAvx2(u,b,out,n); break;
+  }
+#endif
+  for (; i<n; i++) out[i]=-b*Log1(1.0-u[i]);
+}
+
+/////////////////////////////////////////////////////////////////////
+// CLASS VariateStream
+/////////////////////////////////////////////////////////////////////
+// Buffered variates from one random stream
+/////////////////////////////////////////////////////////////////////
+
+// Law of a transform: a+b*u (log=0) or -b*log(1-u) (log=1, a=0)
+
+struct VariateLaw {
+  int log;                              // 1: logarithm kernel
+  double a, b;                          // Coefficients
+};
+
+class VariateStream {
+
+  public:
+
+    // Methods
+
+    VariateStream(RandomStream *gen);   // Constructor
+    void SetStream(RandomStream *gen);  // New underlying stream (drops buffer)
+    void Reset();                       // Drops buffered uniforms
+    RandomStream *Stream();             // Returns underlying stream
+    double Next();                      // Returns next uniform
+    SimReal Exp(SimReal avg);           // Exponential law
+    SimReal Uni(SimReal min, SimReal max); // Uniform law
+    SimReal Poisson(SimReal lambda);    // Poisson law (interarrival)
+    void ExpBlock(double avg, double *out, int n); // n exponential draws
+    void UniBlock(double min, double max, double *out, int n); // n uniform draws
+    void PoissonBlock(double lambda, double *out, int n); // n Poisson draws
+    void Write(FILE *f);                // Writes buffered uniforms (checkpoint)
+    int Read(FILE *f);                  // Reads buffered uniforms (1: ok)
+
+  private:
+
+    // Internal methods
+
+    void Refill();                      // New block of uniforms
+    double Draw(int log, double a, double b); // Next variate of a law
+    void Block(int log, double a, double b, double *out, int n); // Transform
+
+    // Private attributes
+
+    RandomStream *rg;                   // Underlying stream
+    double u[VARBUF];                   // Buffered uniforms
+    int pos;                            // Next uniform in u
+    VariateLaw laws[VAR_LAWS];          // Laws last drawn
+    int nlaws;                          // Number of laws in laws
+    unsigned long used[VAR_LAWS];       // Last draw of laws[i] (clock)
+    unsigned long clock;                // Draws of a law
+    double v[VAR_LAWS][VARBUF];         // Block transformed for laws[i]
+    int done[VAR_LAWS];                 // 1 if v[i] holds u[pos..] transformed
+
+};
+
+// CLASS VariateStream: Constructor
+
+VariateStream::VariateStream(RandomStream *gen) {
+
+  rg=gen;
+  nlaws=0;
+  clock=0;
+  Reset();
+}
+
+// CLASS VariateStream: New underlying stream (buffered uniforms are
+// dropped)
+
+void VariateStream::SetStream(RandomStream *gen) {
+
+  rg=gen;
+  Reset();
+}
+
+// CLASS VariateStream: Drops buffered uniforms
+
+void VariateStream::Reset() {
+
+  int i;
+
+  pos=VARBUF;
+  for (i=0; i<VAR_LAWS; i++) done[i]=0;
+}
+
+// CLASS VariateStream: Returns underlying stream
+
+RandomStream *VariateStream::Stream() {
+
+  return rg;
+}
+
+// CLASS VariateStream: New block of uniforms
+
+void VariateStream::Refill() {
+
+  int i;
+
+  rg->Fill(u,VARBUF);
+  pos=0;
+  for (i=0; i<VAR_LAWS; i++) done[i]=0;
+}
+
+// CLASS VariateStream: Next uniform
+
+double VariateStream::Next() {
+
+  if (pos==VARBUF) Refill();
+  return u[pos++];
+}
+
+// CLASS VariateStream: Next variate of a law (see VariateLaw). A law
+// among the last VAR_LAWS ones drawn gets the rest of the block
+// transformed at once.
+
+double VariateStream::Draw(int log, double a, double b) {
+
+  double x;
+  int i, j;
+
+  if (pos==VARBUF) Refill();
+  clock++;
+  for (i=0; i<nlaws; i++)
+    if ((laws[i].log==log) && (laws[i].a==a) && (laws[i].b==b)) break;
+
+  if (i<nlaws) {
+    used[i]=clock;
+    if (!done[i]) {
+      if (log) LogKernel(u+pos,b,v[i]+pos,VARBUF-pos);
+      else LinearKernel(u+pos,a,b,v[i]+pos,VARBUF-pos);
+      done[i]=1;
+    }
+    return v[i][pos++];
+  }
+
+  // New law: takes a free slot or the least recently drawn one
+  if (nlaws<VAR_LAWS) i=nlaws++;
+  else for (i=0, j=1; j<VAR_LAWS; j++) if (used[j]<used[i]) i=j;
+  laws[i].log=log;
+  laws[i].a=a;
+  laws[i].b=b;
+  used[i]=clock;
+  done[i]=0;
+  x=u[pos++];
+  if (log) return -b*Log1(1.0-x);
+  else return fma(b,x,a);
+}
+
+// CLASS VariateStream: Exponential law
+
+SimReal VariateStream::Exp(SimReal avg) {
+
+  return (SimReal)Draw(1,0,avg);
+}
+
+// CLASS VariateStream: Uniform law
+
+SimReal VariateStream::Uni(SimReal min, SimReal max) {
+
+  return (SimReal)Draw(0,min,(double)max-min);
+}
+
+// CLASS VariateStream: Poisson law
+
+SimReal VariateStream::Poisson(SimReal lambda) {
+
+  return (SimReal)Draw(1,0,1.0/lambda);
+}
+
+// CLASS VariateStream: Transform of the next n uniforms
+// (log=1: -b*log(1-u), a being 0; log=0: a+b*u)
+
+void VariateStream::Block(int log, double a, double b, double *out, int n) {
+
+  int k;
+
+  while (n>0) {
+    if (pos==VARBUF) Refill();
+    k=VARBUF-pos;
+    if (k>n) k=n;
+    if (log) LogKernel(u+pos,b,out,k);
+    else LinearKernel(u+pos,a,b,out,k);
+    pos+=k;
+    out+=k;
+    n-=k;
+  }
+}
+
+// CLASS VariateStream: n exponential draws
+
+void VariateStream::ExpBlock(double avg, double *out, int n) {
+
+  Block(1,0,avg,out,n);
+}
+
+// CLASS VariateStream: n uniform draws
+
+void VariateStream::UniBlock(double min, double max, double *out, int n) {
+
+  Block(0,min,max-min,out,n);
+}
+
+// CLASS VariateStream: n Poisson draws
+
+void VariateStream::PoissonBlock(double lambda, double *out, int n) {
+
+  Block(1,0,1.0/lambda,out,n);
+}
+
+// CLASS VariateStream: Writes the uniforms not consumed yet (the
+// underlying stream is written by its owner)
+
+void VariateStream::Write(FILE *f) {
+
+  fwrite(&pos,sizeof(pos),1,f);
+  if (pos<VARBUF) fwrite(u+pos,sizeof(double),VARBUF-pos,f);
+}
+
+// CLASS VariateStream: Reads the uniforms written by Write()
+// (1 if successful, 0 otherwise)
+
+int VariateStream::Read(FILE *f) {
+
+  int ok=1, p;
+
+  Reset();
+  ok&=(fread(&p,sizeof(p),1,f)==1);
+  if (ok && ((p<0) || (p>VARBUF))) ok=0;
+  if (ok && (p<VARBUF)) ok&=(fread(u+p,sizeof(double),VARBUF-p,f)==(size_t)(VARBUF-p));
+  if (ok) pos=p;
+  return ok;
+}
@@ -0,0 +1,54 @@
+/////////////////////////////////////////////////////////////////////
+// tracedump.cc: Binary event trace decoder (see simtrace.h)
+/////////////////////////////////////////////////////////////////////
+// Usage: tracedump [-c] tracefile
+//   default: one line of text per event
+//   -c:      CSV (replication,date,code,client,resource)
+/////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include "simtrace.h"
+
+int main(int argc, char *argv[]) {
+
+  FILE *f;
+  TraceHeader h;
+  TraceRecord r[TRACE_BLOCK];
+  const char *name=NULL;
+  int csv=0, i, n;
+
+  for (i=1; i<argc; i++)
+    if (strcmp(argv[i],"-c")==0) csv=1;
+    else name=argv[i];
+
+  if (name==NULL) {
+    printf("Usage: tracedump [-c] tracefile\n");
+    return 1;
+  }
+
+  f=fopen(name,"rb");
+  if (f==NULL) {
+    printf("Error: cannot open trace file %s\n",name);
+    return 1;
+  }
+  if ((fread(&h,sizeof(h),1,f)!=1) || (h.magic!=TRACE_MAGIC)) {
+    printf("Error: %s is not a trace file\n",name);
+    return 1;
+  }
+  if ((h.version!=TRACE_VERSION) || (h.recsize!=sizeof(TraceRecord))) {
+    printf("Error: unsupported trace version %u (record size %u)\n",h.version,h.recsize);
+    return 1;
+  }
+
+  if (csv) printf("replication,date,code,client,resource\n");
+  while ((n=fread(r,sizeof(TraceRecord),TRACE_BLOCK,f))>0)
+    for (i=0; i<n; i++)
+      if (csv) printf("%d,%.6f,%d,%d,%d\n",r[i].replic,r[i].date,r[i].code,
+                      r[i].client,r[i].resource);
+      else printf("[%d] Event #%d client %d resource %d at time %f\n",r[i].replic,
+                  r[i].code,r[i].client,r[i].resource,r[i].date);
+
+  fclose(f);
+  return 0;
+}